@@ -11,6 +11,20 @@ static const char selfgcolor[]      = "#eeeeee";
 
 static const int bordersize = 1;  /* widget border spacing in pixels */
 
+/* window size with -H, there is no screen to fill */
+static const unsigned int headlesswidth  = 640;
+static const unsigned int headlessheight = 480;
+
+/* unmapped windows kept ready for the window command, 0 disables */
+static const unsigned int windowpool = 2;
+
+/* bytes of pixmaps kept for windows that are unmapped or fully obscured,
+ * the longest hidden ones are released and repainted once shown */
+static const size_t hiddenbudget = 32 << 20;
+
+/* strftime format of clock widgets added without one */
+static const char clockformat[] = "%H:%M:%S";
+
 #define MODKEY ControlMask
 static Key keys[] = { \
 	/* modifier                     key        function        argument */
@@ -18,4 +32,5 @@ static Key keys[] = { \
 	{ MODKEY,                       XK_c,      closewindow,    { 0 } },
 	{ MODKEY,                       XK_j,      toggleselect,   { .i = +1 } },
 	{ MODKEY,                       XK_k,      toggleselect,   { .i = -1 } },
+	{ 0,                            XK_i,      insertmode,     { 0 } },
 };
@@ -7,12 +7,24 @@ VERSION = 0.1
 PREFIX = /usr/local
 MANPREFIX = ${PREFIX}/share/man
 
+# XCB request pipelining, comment if you don't want it
+#XCBLIBS = -lX11-xcb -lxcb
+#XCBFLAGS = -DXCB
+
+# X Present extension, comment if you don't want it
+#PRESENTLIBS = -lXpresent -lXfixes
+#PRESENTFLAGS = -DPRESENT
+
+# MIT-SHM image uploads, comment if you don't want it
+#SHMLIBS = -lXext
+#SHMFLAGS = -DSHM
+
 # includes and libs
 INCS = -I. -I/usr/include
-LIBS = -L/usr/lib -lc -lX11
+LIBS = -L/usr/lib -lc -lX11 -lpthread -lrt ${XCBLIBS} ${PRESENTLIBS} ${SHMLIBS}
 
 # flags
-CPPFLAGS = -DVERSION=\"${VERSION}\"
+CPPFLAGS = -D_POSIX_C_SOURCE=200809L -DVERSION=\"${VERSION}\" ${XCBFLAGS} ${PRESENTFLAGS} ${SHMFLAGS}
 CFLAGS = -std=c99 -pedantic -Wall -Os ${INCS} ${CPPFLAGS}
 # LDFLAGS = -s ${LIBS}
 LDFLAGS = -g ${LIBS}
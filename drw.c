@@ -1,11 +1,212 @@
 /* See LICENSE file for copyright and license details. */
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#ifdef XCB
+#include <X11/Xlib-xcb.h>
+#endif
+#ifdef PRESENT
+#include <X11/extensions/Xpresent.h>
+#endif
+#ifdef SHM
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#endif
 
 #include "drw.h"
 #include "util.h"
+#include "glyphs.h"
+
+/* a Drw without a display renders into its in-memory framebuffer */
+#define HEADLESS(drw)           (!(drw)->dpy)
+
+#ifdef PRESENT
+typedef struct PresentDpy PresentDpy;
+struct PresentDpy {
+	Display *dpy;
+	int opcode; /* 0 extension missing */
+	PresentDpy *next;
+};
+
+static PresentDpy *presentdpys; /* displays already queried */
+static Drw *presentdrws;
+
+static int
+present_opcode(Display *dpy) {
+	PresentDpy *p;
+	int opcode, evbase, errbase;
+
+	if(!dpy)
+		return 0;
+	for(p = presentdpys; p; p = p->next)
+		if(p->dpy == dpy)
+			return p->opcode;
+	if(!(p = (PresentDpy *)calloc(1, sizeof(PresentDpy))))
+		return 0;
+	p->dpy = dpy;
+	p->opcode = XPresentQueryExtension(dpy, &opcode, &evbase, &errbase) ? opcode : 0;
+	p->next = presentdpys;
+	presentdpys = p;
+	return p->opcode;
+}
+
+static int
+present_supported(Display *dpy) {
+	return present_opcode(dpy) > 0;
+}
+
+static void
+present_createbufs(Drw *drw) {
+	int i;
+
+	for(i = 0; i < DRW_NBUFS; i++) {
+		drw->bufs[i] = XCreatePixmap(drw->dpy, drw->root, drw->w, drw->h,
+				DefaultDepth(drw->dpy, drw->screen));
+		drw->idle[i] = True;
+	}
+	drw->back = 0;
+	drw->drawable = drw->bufs[0];
+}
+
+static void
+present_freebufs(Drw *drw) {
+	int i;
+
+	if(drw->drawable == 0)
+		return;
+	for(i = 0; i < DRW_NBUFS; i++)
+		XFreePixmap(drw->dpy, drw->bufs[i]);
+	drw->drawable = 0;
+}
+
+static Bool
+ispresentevent(Display *dpy, XEvent *ev, XPointer arg) {
+	return ev->type == GenericEvent && ev->xcookie.extension == present_opcode(dpy);
+}
+
+/* returns an idle back buffer, waiting for the server to release one */
+static int
+present_acquire(Drw *drw) {
+	XEvent ev;
+	int i;
+
+	for(;;) {
+		for(i = 0; i < DRW_NBUFS; i++)
+			if(drw->idle[i])
+				return i;
+		XIfEvent(drw->dpy, &ev, ispresentevent, NULL);
+		drw_present_event(drw->dpy, &ev);
+	}
+}
+
+static void
+present_map(Drw *drw, Window win, int x, int y, unsigned int w, unsigned int h) {
+	XRectangle r = { x, y, w, h };
+	XserverRegion update;
+	int front;
+
+	if(drw->presentwin != win) {
+		XPresentSelectInput(drw->dpy, win, PresentIdleNotifyMask|PresentCompleteNotifyMask);
+		drw->presentwin = win;
+	}
+	update = XFixesCreateRegion(drw->dpy, &r, 1);
+	XPresentPixmap(drw->dpy, win, drw->drawable, ++drw->serial, None, update, 0, 0,
+			None, None, None, PresentOptionNone, 0, 0, 0, NULL, 0);
+	XFixesDestroyRegion(drw->dpy, update);
+	front = drw->back;
+	drw->idle[front] = False;
+	drw->inflight++;
+
+	/* never draw into a buffer the server may still read, the new back
+	 * buffer starts as a copy of the frame just presented */
+	drw->back = present_acquire(drw);
+	drw->drawable = drw->bufs[drw->back];
+	XCopyArea(drw->dpy, drw->bufs[front], drw->drawable, drw->gc, 0, 0, drw->w, drw->h, 0, 0);
+	XFlush(drw->dpy);
+}
+
+int
+drw_busy(Drw *drw) {
+	return drw && drw->inflight > 0;
+}
+
+int
+drw_present_event(Display *dpy, XEvent *ev) {
+	XPresentIdleNotifyEvent *ie;
+	XPresentCompleteNotifyEvent *ce;
+	Drw *drw;
+	int i;
+
+	if(!ispresentevent(dpy, ev, NULL))
+		return 0;
+	if(!XGetEventData(dpy, &ev->xcookie))
+		return 1;
+	switch(ev->xcookie.evtype) {
+	case PresentIdleNotify:
+		ie = ev->xcookie.data;
+		/* xids are only unique per server */
+		for(drw = presentdrws; drw; drw = drw->next)
+			for(i = 0; drw->dpy == dpy && drw->presentwin == ie->window && i < DRW_NBUFS; i++)
+				if(drw->bufs[i] == ie->pixmap)
+					drw->idle[i] = True;
+		break;
+	case PresentCompleteNotify:
+		ce = ev->xcookie.data;
+		for(drw = presentdrws; drw; drw = drw->next)
+			if(drw->dpy == dpy && drw->presentwin == ce->window && drw->inflight > 0)
+				drw->inflight--;
+		break;
+	}
+	XFreeEventData(dpy, &ev->xcookie);
+	return 1;
+}
+#else
+int
+drw_busy(Drw *drw) {
+	return 0;
+}
+
+int
+drw_present_event(Display *dpy, XEvent *ev) {
+	return 0;
+}
+#endif
+
+#ifdef SHM
+/* MIT-SHM only attaches System V segments, so the caller's pixels are
+ * staged through one the server reads without a trip over the socket */
+static int
+shm_attach(Drw *drw, Img *img, Visual *vis, int depth) {
+	XImage *xi;
+
+	if(!XShmQueryExtension(drw->dpy)
+	|| !(xi = XShmCreateImage(drw->dpy, vis, depth, ZPixmap, NULL, &img->shm, img->w, img->h)))
+		return 0;
+	if((img->shm.shmid = shmget(IPC_PRIVATE, (size_t)xi->bytes_per_line * img->h, IPC_CREAT | 0600)) == -1) {
+		XDestroyImage(xi);
+		return 0;
+	}
+	img->shm.shmaddr = shmat(img->shm.shmid, NULL, 0);
+	img->shm.readOnly = True;
+	if(img->shm.shmaddr == (char *)-1 || !XShmAttach(drw->dpy, &img->shm)) {
+		if(img->shm.shmaddr != (char *)-1)
+			shmdt(img->shm.shmaddr);
+		shmctl(img->shm.shmid, IPC_RMID, NULL);
+		img->shm.shmaddr = NULL;
+		XDestroyImage(xi);
+		return 0;
+	}
+	XSync(drw->dpy, False);
+	/* removed once both sides detach */
+	shmctl(img->shm.shmid, IPC_RMID, NULL);
+	xi->data = img->shm.shmaddr;
+	img->ximg = xi;
+	return 1;
+}
+#endif
 
 Drw *
 drw_create(Display *dpy, int screen, Window root, unsigned int w, unsigned int h) {
@@ -17,8 +218,21 @@ drw_create(Display *dpy, int screen, Window root, unsigned int w, unsigned int h
 	drw->root = root;
 	drw->w = w;
 	drw->h = h;
-	drw->drawable = XCreatePixmap(dpy, root, w, h, DefaultDepth(dpy, screen));
+	if(!dpy) {
+		if(!(drw->fb = (unsigned int *)calloc((size_t)w * h, sizeof(unsigned int))))
+			die("error, cannot allocate framebuffer\n");
+		return drw;
+	}
 	drw->gc = XCreateGC(dpy, root, 0, NULL);
+#ifdef PRESENT
+	if(present_supported(dpy)) {
+		present_createbufs(drw);
+		drw->next = presentdrws;
+		presentdrws = drw;
+	}
+	else
+#endif
+	drw->drawable = XCreatePixmap(dpy, root, w, h, DefaultDepth(dpy, screen));
 	XSetLineAttributes(dpy, drw->gc, 1, LineSolid, CapButt, JoinMiter);
 	return drw;
 }
@@ -29,6 +243,19 @@ drw_resize(Drw *drw, unsigned int w, unsigned int h) {
 		return;
 	drw->w = w;
 	drw->h = h;
+	if(HEADLESS(drw)) {
+		free(drw->fb);
+		if(!(drw->fb = (unsigned int *)calloc((size_t)w * h, sizeof(unsigned int))))
+			die("error, cannot allocate framebuffer\n");
+		return;
+	}
+#ifdef PRESENT
+	if(present_supported(drw->dpy)) {
+		present_freebufs(drw);
+		present_createbufs(drw);
+		return;
+	}
+#endif
 	if(drw->drawable != 0)
 		XFreePixmap(drw->dpy, drw->drawable);
 	drw->drawable = XCreatePixmap(drw->dpy, drw->root, w, h, DefaultDepth(drw->dpy, drw->screen));
@@ -36,11 +263,85 @@ drw_resize(Drw *drw, unsigned int w, unsigned int h) {
 
 void
 drw_free(Drw *drw) {
-	XFreePixmap(drw->dpy, drw->drawable);
+#ifdef PRESENT
+	Drw **d;
+#endif
+
+	if(HEADLESS(drw)) {
+		free(drw->fb);
+		free(drw);
+		return;
+	}
+#ifdef PRESENT
+
+	if(present_supported(drw->dpy)) {
+		for(d = &presentdrws; *d && *d != drw; d = (Drw **)&(*d)->next);
+		if(*d)
+			*d = drw->next;
+		present_freebufs(drw);
+	}
+	else
+#endif
+	if(drw->drawable != 0)
+		XFreePixmap(drw->dpy, drw->drawable);
 	XFreeGC(drw->dpy, drw->gc);
 	free(drw);
 }
 
+/* frees the backing store until the next drw_resize(), nothing may be
+ * drawn meanwhile */
+void
+drw_release(Drw *drw) {
+	if(!drw)
+		return;
+	if(HEADLESS(drw)) {
+		free(drw->fb);
+		drw->fb = NULL;
+		return;
+	}
+#ifdef PRESENT
+	if(present_supported(drw->dpy)) {
+		present_freebufs(drw);
+		return;
+	}
+#endif
+	if(drw->drawable != 0)
+		XFreePixmap(drw->dpy, drw->drawable);
+	drw->drawable = 0;
+}
+
+/* how frames reach the screen: memory, present or copy */
+const char *
+drw_backend(Drw *drw) {
+	if(HEADLESS(drw))
+		return "memory";
+#ifdef PRESENT
+	if(present_supported(drw->dpy))
+		return "present";
+#endif
+	return "copy";
+}
+
+/* bytes the backing store takes, 0 once released */
+size_t
+drw_bytes(Drw *drw) {
+	size_t n;
+
+	if(!drw)
+		return 0;
+	n = (size_t)drw->w * drw->h;
+	if(HEADLESS(drw))
+		return drw->fb ? n * sizeof(unsigned int) : 0;
+	if(drw->drawable == 0)
+		return 0;
+	n *= DefaultDepth(drw->dpy, drw->screen) > 16 ? 4 : 2;
+#ifdef PRESENT
+	if(present_supported(drw->dpy))
+		n *= DRW_NBUFS;
+#endif
+	return n;
+}
+
 Fnt *
 drw_font_create(Display *dpy, const char *fontname) {
 	Fnt *font;
@@ -50,6 +351,13 @@ drw_font_create(Display *dpy, const char *fontname) {
 	font = (Fnt *)calloc(1, sizeof(Fnt));
 	if(!font)
 		return NULL;
+	if(!dpy) {
+		/* built-in bitmap font, one pixel of descent and spacing */
+		font->ascent = GLYPHH;
+		font->descent = 1;
+		font->h = font->ascent + font->descent;
+		return font;
+	}
 	font->set = XCreateFontSet(dpy, fontname, &missing, &n, &def);
 	if(missing) {
 		while(n--)
@@ -84,11 +392,23 @@ drw_font_free(Display *dpy, Fnt *font) {
 		return;
 	if(font->set)
 		XFreeFontSet(dpy, font->set);
-	else
+	else if(font->xfont)
 		XFreeFont(dpy, font->xfont);
 	free(font);
 }
 
+static int
+parsehexcolor(const char *clrname, XColor *color) {
+	unsigned int r, g, b;
+
+	if(strlen(clrname) != 7 || sscanf(clrname, "#%2x%2x%2x", &r, &g, &b) != 3)
+		return 0;
+	color->red = r * 0x101;
+	color->green = g * 0x101;
+	color->blue = b * 0x101;
+	return 1;
+}
+
 Clr *
 drw_clr_create(Drw *drw, const char *clrname) {
 	Clr *clr;
@@ -100,6 +420,12 @@ drw_clr_create(Drw *drw, const char *clrname) {
 	clr = (Clr *)calloc(1, sizeof(Clr));
 	if(!clr)
 		return NULL;
+	if(HEADLESS(drw)) {
+		if(!parsehexcolor(clrname, &color))
+			die("error, headless colors must be #rrggbb: '%s'\n", clrname);
+		clr->rgb = (color.red >> 8) << 16 | (color.green >> 8) << 8 | (color.blue >> 8);
+		return clr;
+	}
 	cmap = DefaultColormap(drw->dpy, drw->screen);
 	if(!XAllocNamedColor(drw->dpy, cmap, clrname, &color, &color))
 		die("error, cannot allocate color '%s'\n", clrname);
@@ -107,6 +433,210 @@ drw_clr_create(Drw *drw, const char *clrname) {
 	return clr;
 }
 
+typedef struct {
+	Display *dpy;
+	unsigned int rgb;
+	Clr *clr;
+} ClrCacheEntry;
+
+/* colours allocated through drw_clr_rgb(), shared by the Drws of a display,
+ * the displays may paint from different threads */
+static ClrCacheEntry *clrcache;
+static unsigned int clrcachesize, clrcachelen;
+static pthread_mutex_t clrlock = PTHREAD_MUTEX_INITIALIZER;
+
+static unsigned long
+scalemask(unsigned short c, unsigned long mask) {
+	int shift = 0, bits = 0;
+
+	if(!mask)
+		return 0;
+	while(!(mask & 1)) {
+		mask >>= 1;
+		shift++;
+	}
+	while(mask & 1) {
+		mask >>= 1;
+		bits++;
+	}
+	return ((unsigned long)c >> (16 - bits)) << shift;
+}
+
+static unsigned char
+unscalemask(unsigned long pixel, unsigned long mask) {
+	int bits = 0;
+
+	if(!mask)
+		return 0;
+	while(!(mask & 1)) {
+		mask >>= 1;
+		pixel >>= 1;
+	}
+	while(mask & (1UL << bits))
+		bits++;
+	pixel &= mask;
+	return bits >= 8 ? pixel >> (bits - 8) : pixel * 255 / ((1UL << bits) - 1);
+}
+
+static unsigned int
+clrhash(Display *dpy, unsigned int rgb) {
+	return ((rgb ^ (unsigned int)((size_t)dpy >> 4)) * 2654435761u) & (clrcachesize - 1);
+}
+
+static void
+clrcacheinsert(Display *dpy, unsigned int rgb, Clr *clr) {
+	unsigned int i;
+
+	for(i = clrhash(dpy, rgb); clrcache[i].clr; i = (i + 1) & (clrcachesize - 1));
+	clrcache[i].dpy = dpy;
+	clrcache[i].rgb = rgb;
+	clrcache[i].clr = clr;
+	clrcachelen++;
+}
+
+int
+drw_clr_parse(Drw *drw, const char *clrname, unsigned int *rgb) {
+	XColor color;
+
+	if(!drw || !clrname)
+		return 0;
+	/* #rrggbb is parsed locally, names need the server's colour database */
+	if(!parsehexcolor(clrname, &color)
+	&& (HEADLESS(drw) || !XParseColor(drw->dpy, DefaultColormap(drw->dpy, drw->screen), clrname, &color)))
+		return 0;
+	*rgb = (color.red >> 8) << 16 | (color.green >> 8) << 8 | (color.blue >> 8);
+	return 1;
+}
+
+Clr *
+drw_clr_rgb(Drw *drw, unsigned int rgb) {
+	ClrCacheEntry *old;
+	Visual *vis;
+	XColor color;
+	Clr *clr;
+	unsigned int i, oldsize;
+
+	if(!drw)
+		return NULL;
+	pthread_mutex_lock(&clrlock);
+	if(clrcachesize) {
+		for(i = clrhash(drw->dpy, rgb); clrcache[i].clr; i = (i + 1) & (clrcachesize - 1)) {
+			if(clrcache[i].rgb == rgb && clrcache[i].dpy == drw->dpy) {
+				clr = clrcache[i].clr;
+				pthread_mutex_unlock(&clrlock);
+				return clr;
+			}
+		}
+	}
+
+	if(!(clr = (Clr *)calloc(1, sizeof(Clr)))) {
+		pthread_mutex_unlock(&clrlock);
+		return NULL;
+	}
+	color.red = ((rgb >> 16) & 0xff) * 0x101;
+	color.green = ((rgb >> 8) & 0xff) * 0x101;
+	color.blue = (rgb & 0xff) * 0x101;
+	if(HEADLESS(drw)) {
+		clr->rgb = rgb;
+	}
+	else if((vis = DefaultVisual(drw->dpy, drw->screen))->class == TrueColor) {
+		/* the pixel value can be computed without asking the server */
+		clr->rgb = scalemask(color.red, vis->red_mask)
+		         | scalemask(color.green, vis->green_mask)
+		         | scalemask(color.blue, vis->blue_mask);
+	}
+	else {
+		if(!XAllocColor(drw->dpy, DefaultColormap(drw->dpy, drw->screen), &color))
+			die("error, cannot allocate color '#%06x'\n", rgb);
+		clr->rgb = color.pixel;
+	}
+
+	/* keep the table at most half full */
+	if((clrcachelen + 1) * 2 > clrcachesize) {
+		old = clrcache;
+		oldsize = clrcachesize;
+		clrcachesize = oldsize ? oldsize * 2 : 64;
+		if(!(clrcache = (ClrCacheEntry *)calloc(clrcachesize, sizeof(ClrCacheEntry))))
+			die("error, cannot grow color cache\n");
+		clrcachelen = 0;
+		for(i = 0; i < oldsize; i++)
+			if(old[i].clr)
+				clrcacheinsert(old[i].dpy, old[i].rgb, old[i].clr);
+		free(old);
+	}
+	clrcacheinsert(drw->dpy, rgb, clr);
+	pthread_mutex_unlock(&clrlock);
+	return clr;
+}
+
+void
+drw_clr_cache_free(void) {
+	unsigned int i;
+
+	for(i = 0; i < clrcachesize; i++)
+		free(clrcache[i].clr);
+	free(clrcache);
+	clrcache = NULL;
+	clrcachesize = clrcachelen = 0;
+}
+
+#ifdef XCB
+/* issue all allocations first and collect the replies afterwards, so n
+ * colours cost a single round-trip */
+void
+drw_clrs_create(Drw *drw, const char *clrnames[], Clr *clrs[], unsigned int n) {
+	xcb_connection_t *c;
+	xcb_colormap_t cmap;
+	xcb_alloc_color_cookie_t ck[n];
+	xcb_alloc_named_color_cookie_t nck[n];
+	xcb_alloc_color_reply_t *r;
+	xcb_alloc_named_color_reply_t *nr;
+	XColor color;
+	unsigned int i;
+	int hex[n];
+
+	if(!drw)
+		return;
+	if(HEADLESS(drw)) {
+		for(i = 0; i < n; i++)
+			clrs[i] = drw_clr_create(drw, clrnames[i]);
+		return;
+	}
+	c = XGetXCBConnection(drw->dpy);
+	cmap = DefaultColormap(drw->dpy, drw->screen);
+	for(i = 0; i < n; i++) {
+		if((hex[i] = parsehexcolor(clrnames[i], &color)))
+			ck[i] = xcb_alloc_color(c, cmap, color.red, color.green, color.blue);
+		else
+			nck[i] = xcb_alloc_named_color(c, cmap, strlen(clrnames[i]), clrnames[i]);
+	}
+	for(i = 0; i < n; i++) {
+		if(!(clrs[i] = (Clr *)calloc(1, sizeof(Clr))))
+			die("error, cannot allocate color '%s'\n", clrnames[i]);
+		if(hex[i]) {
+			if(!(r = xcb_alloc_color_reply(c, ck[i], NULL)))
+				die("error, cannot allocate color '%s'\n", clrnames[i]);
+			clrs[i]->rgb = r->pixel;
+			free(r);
+		}
+		else {
+			if(!(nr = xcb_alloc_named_color_reply(c, nck[i], NULL)))
+				die("error, cannot allocate color '%s'\n", clrnames[i]);
+			clrs[i]->rgb = nr->pixel;
+			free(nr);
+		}
+	}
+}
+#else
+void
+drw_clrs_create(Drw *drw, const char *clrnames[], Clr *clrs[], unsigned int n) {
+	unsigned int i;
+
+	for(i = 0; i < n; i++)
+		clrs[i] = drw_clr_create(drw, clrnames[i]);
+}
+#endif
+
 void
 drw_clr_free(Clr *clr) {
 	if(clr)
@@ -125,14 +655,79 @@ drw_setscheme(Drw *drw, ClrScheme *scheme) {
 		drw->scheme = scheme;
 }
 
+static void
+fbfill(Drw *drw, int x, int y, unsigned int w, unsigned int h, unsigned long pixel) {
+	int x0 = MAX(x, 0), y0 = MAX(y, 0);
+	int x1 = MIN(x + (int)w, (int)drw->w), y1 = MIN(y + (int)h, (int)drw->h);
+	int i, j;
+
+	for(j = y0; j < y1; j++)
+		for(i = x0; i < x1; i++)
+			drw->fb[(size_t)j * drw->w + i] = pixel;
+}
+
+/* draws the built-in glyphs with the baseline at y, clipped to [x, xmax) */
+static void
+fbstring(Drw *drw, int x, int y, int xmax, const char *text, int len, unsigned long pixel) {
+	const unsigned char *g;
+	unsigned char c;
+	int i, col, row, px, py;
+
+	for(i = 0; i < len && x < xmax; i++) {
+		c = text[i];
+		if((c & 0xc0) == 0x80)
+			continue; /* UTF-8 continuation byte */
+		if(c < GLYPHFIRST || c > GLYPHLAST)
+			c = '?';
+		g = glyphs[c - GLYPHFIRST];
+		for(col = 0; col < GLYPHW; col++) {
+			px = x + col;
+			if(px < 0 || px >= xmax || px >= (int)drw->w)
+				continue;
+			for(row = 0; row < GLYPHH; row++) {
+				py = y - GLYPHH + row;
+				if((g[col] >> row) & 1 && py >= 0 && py < (int)drw->h)
+					drw->fb[(size_t)py * drw->w + px] = pixel;
+			}
+		}
+		x += GLYPHW + 1;
+	}
+}
+
+void
+drw_fill(Drw *drw, int x, int y, unsigned int w, unsigned int h, Clr *clr) {
+	if(!drw || !clr)
+		return;
+	if(HEADLESS(drw)) {
+		fbfill(drw, x, y, w, h, clr->rgb);
+		return;
+	}
+	XSetForeground(drw->dpy, drw->gc, clr->rgb);
+	XFillRectangle(drw->dpy, drw->drawable, drw->gc, x, y, w, h);
+}
+
 void
 drw_rect(Drw *drw, int x, int y, unsigned int w, unsigned int h, int filled, int empty, int invert) {
+	Clr *clr;
 	int dx;
 
 	if(!drw || !drw->font || !drw->scheme)
 		return;
-	XSetForeground(drw->dpy, drw->gc, invert ? drw->scheme->bg->rgb : drw->scheme->fg->rgb);
+	clr = invert ? drw->scheme->bg : drw->scheme->fg;
 	dx = (drw->font->ascent + drw->font->descent + 2) / 4;
+	if(HEADLESS(drw)) {
+		if(filled) {
+			fbfill(drw, x+1, y+1, dx+1, dx+1, clr->rgb);
+		}
+		else if(empty) {
+			fbfill(drw, x+1, y+1, dx+1, 1, clr->rgb);
+			fbfill(drw, x+1, y+1+dx, dx+1, 1, clr->rgb);
+			fbfill(drw, x+1, y+1, 1, dx+1, clr->rgb);
+			fbfill(drw, x+1+dx, y+1, 1, dx+1, clr->rgb);
+		}
+		return;
+	}
+	XSetForeground(drw->dpy, drw->gc, clr->rgb);
 	if(filled)
 		XFillRectangle(drw->dpy, drw->drawable, drw->gc, x+1, y+1, dx+1, dx+1);
 	else if(empty)
@@ -140,18 +735,17 @@ drw_rect(Drw *drw, int x, int y, unsigned int w, unsigned int h, int filled, int
 }
 
 void
-drw_text(Drw *drw, int x, int y, unsigned int w, unsigned int h, const char *text, int invert) {
+drw_text(Drw *drw, int x, int y, unsigned int w, unsigned int h, const char *text, unsigned int textlen, int invert) {
 	char buf[256];
 	int i, tx, ty, th, len, olen;
 	Extnts tex;
 
 	if(!drw || !drw->scheme)
 		return;
-	XSetForeground(drw->dpy, drw->gc, invert ? drw->scheme->fg->rgb : drw->scheme->bg->rgb);
-	XFillRectangle(drw->dpy, drw->drawable, drw->gc, x, y, w, h);
+	drw_fill(drw, x, y, w, h, invert ? drw->scheme->fg : drw->scheme->bg);
 	if(!text || !drw->font)
 		return;
-	olen = strlen(text);
+	olen = textlen;
 	drw_font_getexts(drw->font, text, olen, &tex);
 	th = drw->font->ascent + drw->font->descent;
 	ty = y + (h / 2) - (th / 2) + drw->font->ascent;
@@ -164,6 +758,10 @@ drw_text(Drw *drw, int x, int y, unsigned int w, unsigned int h, const char *tex
 	memcpy(buf, text, len);
 	if(len < olen)
 		for(i = len; i && i > len - 3; buf[--i] = '.');
+	if(HEADLESS(drw)) {
+		fbstring(drw, tx, ty, x + w, buf, len, invert ? drw->scheme->bg->rgb : drw->scheme->fg->rgb);
+		return;
+	}
 	XSetForeground(drw->dpy, drw->gc, invert ? drw->scheme->bg->rgb : drw->scheme->fg->rgb);
 	if(drw->font->set)
 		XmbDrawString(drw->dpy, drw->drawable, drw->font->set, drw->gc, tx, ty, buf, len);
@@ -171,14 +769,52 @@ drw_text(Drw *drw, int x, int y, unsigned int w, unsigned int h, const char *tex
 		XDrawString(drw->dpy, drw->drawable, drw->gc, tx, ty, buf, len);
 }
 
+/* draws text from x on over what is there, callers clip it to w */
+void
+drw_string(Drw *drw, int x, int y, unsigned int w, unsigned int h, const char *text, unsigned int textlen) {
+	int ty;
+
+	if(!drw || !drw->scheme || !drw->font || !textlen)
+		return;
+	ty = y + (h / 2) - ((drw->font->ascent + drw->font->descent) / 2) + drw->font->ascent;
+	if(HEADLESS(drw)) {
+		fbstring(drw, x, ty, x + w, text, textlen, drw->scheme->fg->rgb);
+		return;
+	}
+	XSetForeground(drw->dpy, drw->gc, drw->scheme->fg->rgb);
+	if(drw->font->set)
+		XmbDrawString(drw->dpy, drw->drawable, drw->font->set, drw->gc, x, ty, text, textlen);
+	else
+		XDrawString(drw->dpy, drw->drawable, drw->gc, x, ty, text, textlen);
+}
+
 void
 drw_map(Drw *drw, Window win, int x, int y, unsigned int w, unsigned int h) {
-	if(!drw)
+	if(!drw || HEADLESS(drw))
 		return;
+#ifdef PRESENT
+	if(present_supported(drw->dpy)) {
+		present_map(drw, win, x, y, w, h);
+		return;
+	}
+#endif
 	XCopyArea(drw->dpy, drw->drawable, win, drw->gc, x, y, w, h, x, y);
 	XSync(drw->dpy, False);
 }
 
+void
+drw_map_region(Drw *drw, Window win, Region r) {
+	XRectangle box;
+
+	if(!drw || !r || HEADLESS(drw))
+		return;
+	XClipBox(r, &box);
+	XSetRegion(drw->dpy, drw->gc, r);
+	XCopyArea(drw->dpy, drw->drawable, win, drw->gc, box.x, box.y, box.width, box.height, box.x, box.y);
+	XSetClipMask(drw->dpy, drw->gc, None);
+	XFlush(drw->dpy);
+}
+
 
 void
 drw_font_getexts(Fnt *font, const char *text, unsigned int len, Extnts *tex) {
@@ -191,6 +827,12 @@ drw_font_getexts(Fnt *font, const char *text, unsigned int len, Extnts *tex) {
 		tex->w = r.width;
 		tex->h = r.height;
 	}
+	else if(!font->xfont) {
+		tex->h = font->ascent + font->descent;
+		for(tex->w = 0; len--; text++)
+			if((*text & 0xc0) != 0x80)
+				tex->w += GLYPHW + 1;
+	}
 	else {
 		tex->h = font->ascent + font->descent;
 		tex->w = XTextWidth(font->xfont, text, len);
@@ -207,13 +849,123 @@ drw_font_getexts_width(Fnt *font, const char *text, unsigned int len) {
 	return tex.w;
 }
 
+/* sum of glyph advances, ASCII is measured once per font */
+unsigned int
+drw_font_advance(Fnt *font, const char *text, unsigned int len) {
+	unsigned int i, n, w = 0;
+	unsigned char c;
+
+	if(!font || !text)
+		return 0;
+	for(i = 0; i < len; i += n) {
+		c = text[i];
+		if(c < 0x80) {
+			if(!font->adv[c])
+				font->adv[c] = drw_font_getexts_width(font, &text[i], 1);
+			w += font->adv[c];
+			n = 1;
+			continue;
+		}
+		for(n = 1; i + n < len && (text[i + n] & 0xc0) == 0x80; n++);
+		w += drw_font_getexts_width(font, &text[i], n);
+	}
+	return w;
+}
+
+Img *
+drw_img_create(Drw *drw, const unsigned int *pixels, unsigned int w, unsigned int h) {
+	Img *img;
+	Visual *vis;
+	int depth, one = 1;
+
+	if(!drw || !(img = (Img *)calloc(1, sizeof(Img))))
+		return NULL;
+	img->w = w;
+	img->h = h;
+	img->pixels = pixels;
+	if(HEADLESS(drw))
+		return img;
+
+	/* the pixels are uploaded as they are, the visual must match them */
+	vis = DefaultVisual(drw->dpy, drw->screen);
+	depth = DefaultDepth(drw->dpy, drw->screen);
+	if(vis->class != TrueColor || depth < 24 || vis->red_mask != 0xff0000
+	|| vis->green_mask != 0xff00 || vis->blue_mask != 0xff) {
+		free(img);
+		return NULL;
+	}
+#ifdef SHM
+	if(shm_attach(drw, img, vis, depth))
+		return img;
+#endif
+	if(!(img->ximg = XCreateImage(drw->dpy, vis, depth, ZPixmap, 0, (char *)pixels, w, h, 32, w * 4))) {
+		free(img);
+		return NULL;
+	}
+	/* Xlib swaps the rows for the server if needed */
+	img->ximg->byte_order = *(char *)&one ? LSBFirst : MSBFirst;
+	return img;
+}
+
+void
+drw_img_free(Drw *drw, Img *img) {
+	if(!img)
+		return;
+	if(img->ximg) {
+#ifdef SHM
+		if(img->shm.shmaddr) {
+			XShmDetach(drw->dpy, &img->shm);
+			shmdt(img->shm.shmaddr);
+		}
+#endif
+		img->ximg->data = NULL; /* never owned by the XImage */
+		XDestroyImage(img->ximg);
+	}
+	free(img);
+}
+
+/* copies the area sx,sy,w,h of img to x+sx,y+sy */
+void
+drw_img(Drw *drw, int x, int y, Img *img, int sx, int sy, unsigned int w, unsigned int h) {
+	int i, j;
+
+	if(!drw || !img)
+		return;
+	if(sx < 0 || sy < 0 || sx >= (int)img->w || sy >= (int)img->h)
+		return;
+	w = MIN(w, img->w - sx);
+	h = MIN(h, img->h - sy);
+	x += sx;
+	y += sy;
+	if(HEADLESS(drw)) {
+		for(j = 0; j < (int)h; j++)
+			for(i = 0; i < (int)w; i++)
+				if(x + i >= 0 && x + i < (int)drw->w && y + j >= 0 && y + j < (int)drw->h)
+					drw->fb[(size_t)(y + j) * drw->w + x + i] = img->pixels[(size_t)(sy + j) * img->w + sx + i] & 0xffffff;
+		return;
+	}
+#ifdef SHM
+	if(img->shm.shmaddr) {
+		for(j = sy; j < sy + (int)h; j++)
+			memcpy(img->ximg->data + (size_t)j * img->ximg->bytes_per_line + sx * 4,
+					&img->pixels[(size_t)j * img->w + sx], w * 4);
+		XShmPutImage(drw->dpy, drw->drawable, drw->gc, img->ximg, sx, sy, x, y, w, h, False);
+		/* the next upload reuses the staging segment */
+		XSync(drw->dpy, False);
+		return;
+	}
+#endif
+	XPutImage(drw->dpy, drw->drawable, drw->gc, img->ximg, sx, sy, x, y, w, h);
+}
+
 Cur *
 drw_cur_create(Drw *drw, int shape) {
 	Cur *cur = (Cur *)calloc(1, sizeof(Cur));
 
 	if(!drw || !cur)
 		return NULL;
-	cur->cursor = XCreateFontCursor(drw->dpy, shape);
+	if(!HEADLESS(drw))
+		cur->cursor = XCreateFontCursor(drw->dpy, shape);
 	return cur;
 }
 
@@ -221,6 +973,53 @@ void
 drw_cur_free(Drw *drw, Cur *cursor) {
 	if(!drw || !cursor)
 		return;
-	XFreeCursor(drw->dpy, cursor->cursor);
+	if(!HEADLESS(drw))
+		XFreeCursor(drw->dpy, cursor->cursor);
 	free(cursor);
 }
+
+/* writes the drawable as binary PPM, X drawables need a TrueColor visual */
+int
+drw_capture(Drw *drw, const char *path) {
+	XImage *img = NULL;
+	Visual *vis;
+	FILE *f;
+	unsigned long p;
+	unsigned int x, y;
+	unsigned char rgb[3];
+
+	if(!drw)
+		return 0;
+	if(!HEADLESS(drw)) {
+		vis = DefaultVisual(drw->dpy, drw->screen);
+		if(vis->class != TrueColor
+		|| !(img = XGetImage(drw->dpy, drw->drawable, 0, 0, drw->w, drw->h, AllPlanes, ZPixmap)))
+			return 0;
+	}
+	if(!(f = fopen(path, "wb"))) {
+		if(img)
+			XDestroyImage(img);
+		return 0;
+	}
+	fprintf(f, "P6\n%u %u\n255\n", drw->w, drw->h);
+	for(y = 0; y < drw->h; y++) {
+		for(x = 0; x < drw->w; x++) {
+			if(img) {
+				p = XGetPixel(img, x, y);
+				rgb[0] = unscalemask(p, img->red_mask);
+				rgb[1] = unscalemask(p, img->green_mask);
+				rgb[2] = unscalemask(p, img->blue_mask);
+			}
+			else {
+				p = drw->fb[(size_t)y * drw->w + x];
+				rgb[0] = p >> 16;
+				rgb[1] = p >> 8;
+				rgb[2] = p;
+			}
+			fwrite(rgb, 1, sizeof(rgb), f);
+		}
+	}
+	if(img)
+		XDestroyImage(img);
+	return fclose(f) == 0;
+}
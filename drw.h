@@ -1,5 +1,14 @@
 /* See LICENSE file for copyright and license details. */
 #include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#ifdef PRESENT
+#include <stdint.h>
+
+#define DRW_NBUFS 3 /* back buffers per Drw when presenting */
+#endif
+#ifdef SHM
+#include <X11/extensions/XShm.h>
+#endif
 
 typedef struct {
 	unsigned long rgb;
@@ -15,6 +24,7 @@ typedef struct {
 	unsigned int h;
 	XFontSet set;
 	XFontStruct *xfont;
+	unsigned short adv[128]; /* cached ASCII advances, 0 if not measured yet */
 } Fnt;
 
 typedef struct {
@@ -32,6 +42,16 @@ typedef struct {
 	GC gc;
 	ClrScheme *scheme;
 	Fnt *font;
+	unsigned int *fb;       /* 0xRRGGBB pixels when there is no display */
+#ifdef PRESENT
+	Pixmap bufs[DRW_NBUFS]; /* drawable is bufs[back] */
+	Bool idle[DRW_NBUFS];   /* the server no longer reads the buffer */
+	int back;
+	int inflight;           /* presented frames not completed yet */
+	uint32_t serial;
+	Window presentwin;
+	void *next;             /* list of presenting Drws */
+#endif
 } Drw;
 
 typedef struct {
@@ -39,20 +59,42 @@ typedef struct {
 	unsigned int h;
 } Extnts;
 
-/* Drawable abstraction */
+typedef struct {
+	unsigned int w, h;
+	const unsigned int *pixels; /* 0xRRGGBB rows, owned by the caller */
+	XImage *ximg;
+#ifdef SHM
+	XShmSegmentInfo shm;        /* staging segment the server reads */
+#endif
+} Img;
+
+/* Drawable abstraction, a NULL display renders into memory */
 Drw *drw_create(Display *dpy, int screen, Window win, unsigned int w, unsigned int h);
 void drw_resize(Drw *drw, unsigned int w, unsigned int h);
 void drw_free(Drw *drw);
+void drw_release(Drw *drw);
+size_t drw_bytes(Drw *drw);
+const char *drw_backend(Drw *drw);
 
 /* Fnt abstraction */
 Fnt *drw_font_create(Display *dpy, const char *fontname);
 void drw_font_free(Display *dpy, Fnt *font);
 void drw_font_getexts(Fnt *font, const char *text, unsigned int len, Extnts *extnts);
 unsigned int drw_font_getexts_width(Fnt *font, const char *text, unsigned int len);
+unsigned int drw_font_advance(Fnt *font, const char *text, unsigned int len);
 
 /* Colour abstraction */
 Clr *drw_clr_create(Drw *drw, const char *clrname);
+void drw_clrs_create(Drw *drw, const char *clrnames[], Clr *clrs[], unsigned int n);
 void drw_clr_free(Clr *clr);
+int drw_clr_parse(Drw *drw, const char *clrname, unsigned int *rgb);
+Clr *drw_clr_rgb(Drw *drw, unsigned int rgb);
+void drw_clr_cache_free(void);
+
+/* Image abstraction, the pixels stay in the caller's memory */
+Img *drw_img_create(Drw *drw, const unsigned int *pixels, unsigned int w, unsigned int h);
+void drw_img_free(Drw *drw, Img *img);
+void drw_img(Drw *drw, int x, int y, Img *img, int sx, int sy, unsigned int w, unsigned int h);
 
 /* Cursor abstraction */
 Cur *drw_cur_create(Drw *drw, int shape);
@@ -63,8 +105,14 @@ void drw_setfont(Drw *drw, Fnt *font);
 void drw_setscheme(Drw *drw, ClrScheme *scheme);
 
 /* Drawing functions */
+void drw_fill(Drw *drw, int x, int y, unsigned int w, unsigned int h, Clr *clr);
 void drw_rect(Drw *drw, int x, int y, unsigned int w, unsigned int h, int filled, int empty, int invert);
-void drw_text(Drw *drw, int x, int y, unsigned int w, unsigned int h, const char *text, int invert);
+void drw_text(Drw *drw, int x, int y, unsigned int w, unsigned int h, const char *text, unsigned int textlen, int invert);
+void drw_string(Drw *drw, int x, int y, unsigned int w, unsigned int h, const char *text, unsigned int textlen);
 
 /* Map functions */
 void drw_map(Drw *drw, Window win, int x, int y, unsigned int w, unsigned int h);
+void drw_map_region(Drw *drw, Window win, Region r);
+int drw_busy(Drw *drw);
+int drw_present_event(Display *dpy, XEvent *ev);
+int drw_capture(Drw *drw, const char *path);
@@ -1,5 +1,8 @@
 /* * See LICENSE file for copyright and license details.  */
 #include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <strings.h>
@@ -13,6 +16,8 @@
 #include <stdarg.h>
 #include <stdbool.h>
 #include <libgen.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
 #include <X11/cursorfont.h>
 #include <X11/Xutil.h>
 #include <X11/Xatom.h>
@@ -27,12 +32,31 @@
 #endif
 
 #define PING_TIMEOUT 300
+#define RINGSIZE     1024 /* queued commands in threaded mode, power of two */
+#define SNAPMAGIC    "SWTS"
+#define SNAPVERSION  4
+#define ARENABLOCK   4096 /* bytes per string arena block */
+#define FIFOCLIENT   1    /* recorded source of fifo commands, its writers look alike */
+#define TICK         10   /* timer resolution, ms */
+#define WHEELBITS    6
+#define WHEELSIZE    (1 << WHEELBITS)
+#define WHEELLEVELS  4    /* 10ms * 64^4, about 46 hours */
 
 #define LENGTH(x)                (sizeof((x)) / sizeof(*(x)))
+#define VISIBLE(w)               ((w)->mapped && !(w)->obscured)
+#define GAPLEN(in)               ((in)->size - ((in)->end - (in)->gap))
+#define GAPAT(in, p)             ((in)->buf[(p) < (in)->gap ? (p) : (p) + (in)->end - (in)->gap])
 #define CLEANMASK(mask)          (mask & (MODKEY))
 
 enum { CurNormal, CurResize, CurMove, CurLast }; /* cursor */
 enum { SchemeNorm, SchemeSel, SchemeLast }; /* color schemes */
+enum { FormatText, FormatJSON }; /* dump and watch output */
+enum { ChgAdded = 1, ChgChanged = 2 }; /* pending watch notifications */
+enum { TimerCommand, TimerClock, TimerBlink }; /* timer types */
+enum { WidgetText, WidgetClock, WidgetInput }; /* text region kinds */
+enum { EvReply = 1 << 0, EvError = 1 << 1, EvDraw = 1 << 2, EvKey = 1 << 3,
+       EvSelect = 1 << 4, EvFocus = 1 << 5, EvHeartbeat = 1 << 6,
+       EvInput = 1 << 7, EvAll = (1 << 8) - 1 }; /* output subscription classes */
 typedef enum { HorizLayout, VertLayout } SwtLayout;
 
 typedef union {
@@ -40,6 +64,11 @@ typedef union {
 	const void *v;
 } Arg;
 
+typedef struct {
+	const char *name;
+	int mask;
+} Subscription;
+
 typedef struct {
 	unsigned int mod;
 	KeySym keysym;
@@ -54,67 +83,298 @@ typedef struct {
 	int h;
 } Rect;
 
+typedef struct {
+	char *attrs;
+	char name[];
+} Command;
+
+typedef struct {
+	unsigned int len;
+	char s[]; /* '\0' terminated */
+} Str;
+
+typedef struct {
+	double at;            /* ms after the first command */
+	unsigned int client;
+	const char *cmd;      /* in the loaded recording, not terminated */
+	size_t len;
+	double latency;       /* ms from due until painted */
+} Record; /* a command of a -P recording */
+
+typedef struct Block Block;
+struct Block {
+	Block *next;
+	size_t used, size;
+	char data[];
+};
+
+typedef struct {
+	Block *blocks;
+	Str **strs;  /* intern table, open addressing */
+	unsigned int size, len;
+	size_t used, dead; /* bytes handed out, bytes no longer referenced */
+} Arena; /* bump allocator, everything is freed at once */
+
+typedef struct {
+	char *buf;
+	unsigned int size;
+	unsigned int gap, end; /* buf[gap..end) is free */
+	unsigned int cursor;   /* the gap only follows it on edits */
+	unsigned int scroll;   /* first byte shown */
+	Bool live;             /* report every edit, not only the value on Enter */
+	Bool stale;            /* the region name lags behind buf */
+} Input; /* gap buffer of an editable region */
+
 typedef struct {
 	Rect r;
-	char name[256];
+	int color; /* 0xRRGGBB foreground, -1 uses the scheme */
+	int changes;
+	Str *name;
+	Bool wrap;
+	unsigned int *lines; /* byte offsets where the wrapped lines start */
+	unsigned int nlines, maxlines;
+	unsigned int wrapw;  /* width the lines were broken for, 0 if never */
+	Str *clock;          /* strftime format of clock regions */
+	unsigned int blink;  /* ms between blinks, 0 doesn't blink */
+	Bool blinkoff;
+	Img *img;            /* image regions show the client memory named by name */
+	int imgfd;           /* file behind img, checked before its pages are read */
+	Rect pending;        /* image area damaged by the client, not uploaded yet */
+	Input *input;        /* input regions edit their text here */
 } SwtText;
 
 typedef struct {
+	Display *dpy;  /* NULL when headless */
+	int screen;
+	Window root;
+	Drw *drw;      /* 1x1, for resources not tied to a window */
+	Cur *cursor[CurLast];
+	Fnt *font;
+	ClrScheme scheme[SchemeLast];
+	pthread_t painter;     /* started once there is a second display */
+	Bool started;
+	Bool painting, quit;   /* guarded by paintlock */
+	char name[];
+} SwtDisplay; /* a server connection and what is allocated on it */
+
+typedef struct {
+	SwtDisplay *disp;
 	Window win;
-	char name[256];
-	char title[256];
+	Arena arena;   /* strings and regions of the window, freed with it */
+	Str *name;
+	Str *title;
 	Drw *drw;
-	Fnt *fnt;
 	SwtText **regions;
 	int sel;
 	int nregions;
 	SwtLayout layout;
+	unsigned int cw, ch; /* latest geometry from ConfigureNotify */
+	Bool dirty;          /* pixmap must be re-rendered */
+	Bool mapped, obscured;
+	Bool released;       /* pixmap freed while hidden */
+	unsigned long hidden; /* when it was hidden, the oldest is released first */
+	Region damage;       /* exposed area pending a copy from the pixmap */
+	Bool uploads;        /* some image region has a pending area */
+	Bool watched;
+	Bool inserting;      /* keys edit the selected input region */
+	int changes;
 } SwtWindow;
 
-static void addtext(SwtWindow *w, char *attrs);
+typedef struct Timer Timer;
+struct Timer {
+	Timer *next;
+	unsigned long id;
+	uint64_t expires;    /* tick it fires at */
+	unsigned int period; /* ticks, 0 fires once */
+	int type;
+	Bool dead;           /* cancelled while firing */
+	SwtWindow *win;      /* region of widget timers */
+	int region;
+	char command[];      /* command of every timers */
+};
+
+static void addimage(SwtWindow *w, char *attrs);
+static void addtext(SwtWindow *w, char *attrs, int kind);
+static Timer *addtimer(int type, unsigned int ms, unsigned int delay, const char *command);
+static void *arenaalloc(Arena *a, size_t size);
 static void cleanup(void);
-static void cleanupwidget(SwtText *w);
+static void closedisplay(SwtDisplay *d);
+static void cleanupregions(SwtWindow *w);
+static Img *checkimage(SwtWindow *w, SwtText *t);
 static void cleanupwindow(SwtWindow *w);
+static int  cancellist(Timer **tp, unsigned long id, SwtWindow *w);
+static int  canceltimers(unsigned long id, SwtWindow *w);
 static void closefifo(void);
+static void closeimage(SwtWindow *w, SwtText *t);
 static void closewindow(const Arg *arg);
+static int  cmplatency(const void *a, const void *b);
+static void compactarena(SwtWindow *w);
 static void configurenotify(const XEvent *ev);
 static void createfifo(void);
 static void createout(void);
+static double cputime(void);
 static SwtWindow *createwindow(char *name, char *title, Bool hlayout);
+static void damageregion(SwtWindow *w, int i);
+static void damagespan(SwtWindow *w, int i, unsigned int from);
 static void destroynotify(const XEvent *ev);
+static void destroywindow(int w, Bool recycle);
 static void draw(SwtWindow *w);
+static int  drawinput(SwtWindow *w, SwtText *t, unsigned int from);
+static int  drawregion(SwtWindow *w, int i, unsigned int from);
+static void dumpjson(int ev, const char *s);
+static void dumpquoted(int ev, const char *s);
 static void dumptree(void);
-static void dumptext(SwtText *w);
-static void dumpwindow(SwtWindow *w);
+static void dumptext(SwtWindow *w, int i, const char *ev);
+static void dumpwindow(SwtWindow *w, const char *ev);
+static void editinput(SwtWindow *w, int i, unsigned int pos, unsigned int del, const char *s, unsigned int n);
 static void *emallocz(size_t size);
+static void execcommand(char *command, char *attributes);
 static void *erealloc(void *o, size_t size);
 static void expose(const XEvent *ev);
+static void fillpool(void);
+static void firetimer(Timer *t);
 static void focusin(const XEvent *ev);
-static int  getwindow(Window w);
+static void frameinput(char *buf, size_t *len, unsigned int from, void (*apply)(char *, char *));
+static void freearena(Arena *a);
+static void gapmove(Input *in, unsigned int pos);
+static unsigned int inputchar(Input *in, unsigned int p, char *c);
+static void inputkey(SwtWindow *w, int i, KeySym typed);
+static void *inputthread(void *arg);
+static void insertmode(const Arg *arg);
+static Str *intern(Arena *a, const char *s, size_t len);
+static Cur *getcursor(SwtDisplay *d, int c);
+static Fnt *getfont(SwtDisplay *d);
+static ClrScheme *getscheme(SwtDisplay *d, int s);
+static int  getwindow(Display *dpy, Window w);
 static int  getwindowc(char *name);
+static int  getwindowh(char *handle);
+static void handlekey(int w, KeySym keysym, KeySym typed, unsigned int state);
+static void hidewindow(SwtWindow *w);
 static void keypress(const XEvent *ev);
+static void loadreplay(const char *path);
+static unsigned int keytext(KeySym keysym, char *buf);
+static void mapnotify(const XEvent *ev);
+static Bool matchtimer(const Timer *t, unsigned long id, SwtWindow *w);
+static long nextrecord(void);
+static long nexttimer(void);
+static char *nextarg(char **s, Bool rest);
+static SwtWindow *newwindow(SwtDisplay *d);
 static void noop(void);
+static SwtDisplay *opendisplay(const char *name);
+static Bool openimage(SwtWindow *w, SwtText *t, unsigned int iw, unsigned int ih);
+static void paint(SwtWindow *w);
+static unsigned long paintdisplay(SwtDisplay *d);
+static void *paintthread(void *arg);
+static void phase(const char *name);
+static unsigned int prevchar(Input *in, unsigned int p);
+static void proccommand(char *command, char *attributes);
 static void procinput(void);
+static void procqueue(void);
 static void procadd(char *attrs);
+static void proccancel(char *attrs);
+static void proccapture(char *attrs);
+static void procdump(char *attrs);
+static void procevery(char *attrs);
+static void procformat(char *attrs);
+static void prockey(char *attrs);
+static void proccolor(char *attrs);
+static void procdamage(char *attrs);
+static void procdisplay(char *attrs);
 static void procremove(char *attrs);
 static void procshow(char *attrs);
+static void procsnapshot(char *attrs);
+static void procsettext(char *attrs);
+static void procsubscribe(char *attrs);
+static void procwatch(char *attrs, Bool watch);
 static void procwindow(char *attrs, Bool hlayout);
-static void procx11events(void);
+static void procx11events(SwtDisplay *d);
+static void queuecommand(char *command, char *attributes);
 static void quit(const Arg *arg);
+static void readinput(void (*apply)(char *, char *));
+static void record(const char *s, size_t len, unsigned int from, double at);
+static Bool recyclewindow(SwtWindow *w);
+static void replay(void);
+static void replayreport(void);
 static void resetfifo(void);
 static void resize(SwtWindow *w);
+static void restore(const char *path);
+static Command *ringpop(void);
+static Bool ringpush(Command *c);
 static void run(void);
+static int  runtimers(void);
+static void scheduletimer(Timer *t);
+static Bool scrollinput(SwtWindow *w, SwtText *t);
+static void setcursor(SwtWindow *w, int i, unsigned int pos);
+static void setinput(Input *in, const char *s, unsigned int len);
+static void settext(SwtWindow *w, int i, const char *text, unsigned int len);
 static void setup(void);
+static void sizewindow(SwtWindow *w);
+static Bool snapread(const char **p, const char *end, void *v, size_t len);
+static Bool snapreadstr(const char **p, const char *end, const char **s, uint32_t *len);
+static void snapwrite(FILE *f, const void *v, size_t len);
+static void snapwritestr(FILE *f, const Str *s);
+static void splitcommand(char *s, void (*apply)(char *, char *));
+static void startreader(void);
+static void stoppainters(void);
+static void stopreader(void);
+static unsigned int strhash(const char *s, size_t len);
+static void syncinput(SwtWindow *w, SwtText *t);
+static void tickclock(SwtWindow *w, int i);
+static uint64_t ticks(void);
+static void trimhidden(void);
 static void toggleselect(const Arg *arg);
+static void updatewindows(void);
+static double uptime(void);
+static void unmapnotify(const XEvent *ev);
+static void uploadimages(SwtWindow *w);
 static void usage(void);
-static void writeout(const char *msg, ...);
+static void visibilitynotify(const XEvent *ev);
+static void watchdiff(void);
+static void warmup(void);
+static void wraptext(SwtWindow *win, SwtText *t, unsigned int width, unsigned int from);
+static unsigned int wrapwidth(SwtWindow *w, SwtText *t);
+static void writeout(int ev, const char *msg, ...);
+static void writepart(int ev, const char *msg, ...);
 
 /* variables */
 char *argv0;
 
 static int infd = -1;
 static int winfd = -1; /* don't write here, it prevents EOF */
-static int x11fd = -1;
+static int evfd = -1;   /* reader thread -> X thread wakeup */
+static int stopfd = -1; /* X thread -> reader thread shutdown */
+static char inbuf[PIPE_BUF * 2];
+static size_t inlen = 0;
+static Bool threaded = False;
+static Bool timings = False;
+static Bool headless = False; /* render into memory, no X display */
+static Window lastxid = 0;    /* window ids handed out when headless */
+static double tparse, tcommand, tlayout, tpaint; /* -T cpu time, ms */
+static unsigned long nlayout, npaint;
+static unsigned long nframes = 0; /* window repaints copied out */
+static FILE *recordfile = NULL;   /* -R */
+static Record *records = NULL;    /* -P */
+static size_t nrecords = 0, nplayed = 0;
+static double speed = 1;          /* -S, 0 replays as fast as possible */
+static double replaystart, replayend;
+static unsigned long replayframes;
+static struct timespec tstart, tlast;
+static int warmed = 0; /* resources created ahead of use by warmup() */
+static pthread_t reader;
+static pthread_mutex_t paintlock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t paintstart = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t paintdone = PTHREAD_COND_INITIALIZER;
+static int npainting = 0;
+static pthread_mutex_t statlock = PTHREAD_MUTEX_INITIALIZER; /* -T counters */
+static Command *ring[RINGSIZE];
+static unsigned int ringhead = 0; /* only advanced by the X thread */
+static unsigned int ringtail = 0; /* only advanced by the reader thread */
+static Timer *wheel[WHEELLEVELS][WHEELSIZE]; /* hierarchical timer wheel */
+static Timer *firing = NULL;  /* due in the tick being run */
+static Timer *current = NULL; /* the one firing right now */
+static uint64_t wheeltick = 0; /* next tick to run */
+static unsigned long lasttimer = 0;
+static unsigned int ntimers = 0;
 
 static void (*handler[LASTEvent]) (const XEvent *) = {
 	[KeyPress] = keypress,
@@ -122,79 +382,317 @@ static void (*handler[LASTEvent]) (const XEvent *) = {
 	[DestroyNotify] = destroynotify,
 	[ConfigureNotify] = configurenotify,
 	[Expose] = expose,
+	[MapNotify] = mapnotify,
+	[UnmapNotify] = unmapnotify,
+	[VisibilityNotify] = visibilitynotify,
 };
 
 static FILE *outfile;
-static char *in = NULL, *out = NULL;
+static char *in = NULL, *out = NULL, *snapfile = NULL, *recordpath = NULL, *replaypath = NULL;
 static Bool running = True;
-static int screen;
-static Display *dpy;
-static Window root;
-static Cur *cursor[CurLast];
-static ClrScheme scheme[SchemeLast];
+static SwtDisplay **displays;
+static int ndisplays = 0;
+static SwtDisplay *disp; /* the display new windows open on */
 static SwtWindow **windows;
 static int nwindows = 0;
+static SwtWindow **pool; /* unmapped windows waiting for a window command */
+static int npool = 0;
+static Bool refill = True;
+static unsigned long lasthidden = 0;
+static Bool trim = False; /* a window was hidden since the last trimhidden() */
 static int sel = -1;
+static int format = FormatText;
+static int subscribed = EvAll;
+static const Subscription subscriptions[] = {
+	{ "replies",    EvReply },
+	{ "errors",     EvError },
+	{ "draw",       EvDraw },
+	{ "keys",       EvKey },
+	{ "selection",  EvSelect },
+	{ "focus",      EvFocus },
+	{ "heartbeat",  EvHeartbeat },
+	{ "input",      EvInput },
+	/* verbosity levels */
+	{ "none",       0 },
+	{ "quiet",      EvReply|EvError },
+	{ "normal",     EvReply|EvError|EvKey|EvSelect|EvFocus|EvInput },
+	{ "all",        EvAll },
+};
+static Bool watchall = False;
+static Bool watchpending = False;
 
 #include "config.h"
 
+/* <width> <height> <name>, name is a POSIX shared memory object or
+ * the path of a file such as /proc/<pid>/fd/<memfd> */
 void
-addtext(SwtWindow *w, char *attrs) {
+addimage(SwtWindow *w, char *attrs) {
+	unsigned int iw = 0, ih = 0;
+	char *arg, *name;
 	SwtText *region;
 
-	region = emallocz(sizeof(*region));
+	if((arg = nextarg(&attrs, False)))
+		iw = strtoul(arg, NULL, 10);
+	if((arg = nextarg(&attrs, False)))
+		ih = strtoul(arg, NULL, 10);
+	if(!iw || !ih || !(name = nextarg(&attrs, True))) {
+		writeout(EvError, "ERROR usage: add <parent> image <width> <height> <name>\n");
+		return;
+	}
 
-	strncpy(region->name, attrs, sizeof(region->name)-1);
+	region = arenaalloc(&w->arena, sizeof(*region));
+	region->color = -1;
+	region->name = intern(&w->arena, name, strlen(name));
+	if(!openimage(w, region, iw, ih))
+		return; /* the region stays unreferenced in the arena */
 
 	w->nregions++;
 	w->regions = erealloc(w->regions, sizeof(SwtText *) * w->nregions);
-
 	w->regions[w->nregions - 1] = region;
+	if(w->watched) {
+		region->changes |= ChgAdded;
+		watchpending = True;
+	}
 
 	resize(w);
 	draw(w);
 }
 
+/* clock regions take their text as a strftime format, input regions
+ * start out with it */
 void
-cleanup(void) {
-	closefifo();
+addtext(SwtWindow *w, char *attrs, int kind) {
+	SwtText *region;
+	unsigned int rgb;
+	char *arg, *text;
+	Bool live = False;
+	Timer *t;
+
+	region = arenaalloc(&w->arena, sizeof(*region));
+	region->color = -1;
+
+	/* optional leading color=<clr>, wrap=<0|1>, blink=<ms> and live=<0|1> attributes */
+	while(attrs && (strncasecmp("color=", attrs, 6) == 0 || strncasecmp("wrap=", attrs, 5) == 0
+	|| strncasecmp("blink=", attrs, 6) == 0 || strncasecmp("live=", attrs, 5) == 0)) {
+		arg = nextarg(&attrs, False);
+		if(strncasecmp("wrap=", arg, 5) == 0)
+			region->wrap = atoi(arg + 5) != 0;
+		else if(strncasecmp("live=", arg, 5) == 0)
+			live = atoi(arg + 5) != 0;
+		else if(strncasecmp("blink=", arg, 6) == 0)
+			region->blink = strtoul(arg + 6, NULL, 10);
+		else if(drw_clr_parse(w->drw, arg + 6, &rgb))
+			region->color = rgb;
+		else
+			writeout(EvError, "ERROR invalid color: %s\n", arg + 6);
+	}
+	if(!(text = nextarg(&attrs, True)))
+		text = kind == WidgetClock ? (char *)clockformat : "";
+	region->name = intern(&w->arena, text, strlen(text));
+	if(kind == WidgetInput) {
+		region->input = emallocz(sizeof(Input));
+		setinput(region->input, text, strlen(text));
+		region->input->live = live;
+		region->wrap = False; /* inputs are a single line */
+	}
+
+	w->nregions++;
+	w->regions = erealloc(w->regions, sizeof(SwtText *) * w->nregions);
+
+	w->regions[w->nregions - 1] = region;
+	if(w->watched) {
+		region->changes |= ChgAdded;
+		watchpending = True;
+	}
+
+	if(region->blink) {
+		t = addtimer(TimerBlink, region->blink, region->blink, NULL);
+		t->win = w;
+		t->region = w->nregions - 1;
+	}
+	/* last, the first tick may compact the arena region lives in */
+	if(kind == WidgetClock) {
+		region->clock = region->name;
+		t = addtimer(TimerClock, 1000, 0, NULL);
+		t->win = w;
+		t->region = w->nregions - 1;
+		tickclock(w, w->nregions - 1);
+	}
+
+	resize(w);
+	draw(w);
+}
 
-	drw_clr_free(scheme[SchemeNorm].border);
-	drw_clr_free(scheme[SchemeNorm].bg);
-	drw_clr_free(scheme[SchemeNorm].fg);
-	drw_clr_free(scheme[SchemeSel].border);
-	drw_clr_free(scheme[SchemeSel].bg);
-	drw_clr_free(scheme[SchemeSel].fg);
+/* fires after delay ms, then every ms unless ms is 0 */
+Timer *
+addtimer(int type, unsigned int ms, unsigned int delay, const char *command) {
+	Timer *t;
+
+	/* an empty wheel can jump to the present instead of running idle ticks */
+	if(!ntimers)
+		wheeltick = ticks();
+	t = emallocz(sizeof(Timer) + (command ? strlen(command) : 0) + 1);
+	if(command)
+		strcpy(t->command, command);
+	t->id = ++lasttimer;
+	t->type = type;
+	t->period = ms ? MAX(ms / TICK, 1) : 0;
+	t->expires = ticks() + MAX(delay / TICK, 1);
+	if(type == TimerClock)
+		t->expires = ticks() + 1; /* realigned to the second when it fires */
+	ntimers++;
+	scheduletimer(t);
+	return t;
+}
+
+void *
+arenaalloc(Arena *a, size_t size) {
+	Block *b = a->blocks;
+	void *p;
 
-	XFreeCursor(dpy, cursor[CurNormal]->cursor);
-	XFreeCursor(dpy, cursor[CurResize]->cursor);
-	XFreeCursor(dpy, cursor[CurMove]->cursor);
-	free(cursor[CurNormal]);
-	free(cursor[CurResize]);
-	free(cursor[CurMove]);
+	size = (size + sizeof(void *) - 1) & ~(sizeof(void *) - 1);
+	if(!b || b->size - b->used < size) {
+		b = emallocz(sizeof(Block) + MAX(size, ARENABLOCK));
+		b->size = MAX(size, ARENABLOCK);
+		b->next = a->blocks;
+		a->blocks = b;
+	}
+	p = b->data + b->used;
+	b->used += size;
+	a->used += size;
+	return p;
+}
 
+void
+cleanup(void) {
+	if(threaded)
+		stopreader();
+	if(in)
+		closefifo();
+
+	if(timings)
+		fprintf(stderr, "swt: cpu parse %.3f ms, layout %.3f ms (%lu), paint %.3f ms (%lu)\n",
+				tparse, tlayout, nlayout, tpaint, npaint);
+	if(records)
+		replayreport();
+	if(recordfile && fclose(recordfile) == EOF)
+		perror("swt unable to close recording");
+
+	stoppainters();
+	canceltimers(0, NULL);
 	for(int i=0;i<nwindows;i++) {
 		cleanupwindow(windows[i]);
 	}
+	for(int i=0;i<npool;i++)
+		cleanupwindow(pool[i]);
+	free(pool);
+	for(int i=0;i<ndisplays;i++)
+		closedisplay(displays[i]);
+	free(displays);
+	drw_clr_cache_free();
 
 	if(fclose(outfile) == -1) {
 		perror("swt unable to close outfile");
 	}
 }
 
-void cleanupwidget(SwtText *w) {
-	free(w);
-}
-
 void cleanupwindow(SwtWindow *w) {
-	drw_font_free(dpy, w->fnt);
+	/* images are released through the drw */
+	cleanupregions(w);
+	XDestroyRegion(w->damage);
 	drw_free(w->drw);
+	free(w);
+}
 
+void
+cleanupregions(SwtWindow *w) {
 	for(int i=0;i<w->nregions;i++) {
-		cleanupwidget(w->regions[i]);
+		free(w->regions[i]->lines);
+		if(w->regions[i]->input) {
+			free(w->regions[i]->input->buf);
+			free(w->regions[i]->input);
+		}
+		if(w->regions[i]->img)
+			closeimage(w, w->regions[i]);
 	}
+	free(w->regions);
+	freearena(&w->arena);
+}
 
-	free(w);
+/* cancels timer id, all timers of w if w is set, or every timer if
+ * neither is given, returns how many were cancelled */
+int
+canceltimers(unsigned long id, SwtWindow *w) {
+	int n = cancellist(&firing, id, w);
+
+	for(int l=0;l<WHEELLEVELS;l++)
+		for(int i=0;i<WHEELSIZE;i++)
+			n += cancellist(&wheel[l][i], id, w);
+	/* runtimers() frees it once it returns */
+	if(current && !current->dead && matchtimer(current, id, w)) {
+		current->dead = True;
+		n++;
+	}
+	return n;
+}
+
+int
+cancellist(Timer **tp, unsigned long id, SwtWindow *w) {
+	Timer *t;
+	int n = 0;
+
+	while((t = *tp)) {
+		if(!matchtimer(t, id, w)) {
+			tp = &t->next;
+			continue;
+		}
+		*tp = t->next;
+		free(t);
+		ntimers--;
+		n++;
+	}
+	return n;
+}
+
+/* drops the image of t once the client truncated its file, the pages
+ * past the end would raise SIGBUS, returns what is left of the image */
+Img *
+checkimage(SwtWindow *w, SwtText *t) {
+	struct stat st;
+
+	if(!t->img || (fstat(t->imgfd, &st) == 0
+	&& (size_t)st.st_size >= (size_t)t->img->w * t->img->h * 4))
+		return t->img;
+	writeout(EvError, "ERROR image \"%s\" was truncated\n", t->name->s);
+	closeimage(w, t);
+	/* the region shows its name now */
+	w->dirty = True;
+	return NULL;
+}
+
+void
+closedisplay(SwtDisplay *d) {
+	for(int i=0;i<SchemeLast;i++) {
+		drw_clr_free(d->scheme[i].border);
+		drw_clr_free(d->scheme[i].bg);
+		drw_clr_free(d->scheme[i].fg);
+	}
+
+	for(int i=0;i<CurLast;i++)
+		drw_cur_free(d->drw, d->cursor[i]);
+
+	drw_font_free(d->dpy, d->font);
+	drw_free(d->drw);
+	if(d->dpy)
+		XCloseDisplay(d->dpy);
+	free(d);
+}
+
+int
+cmplatency(const void *a, const void *b) {
+	double x = *(const double *)a, y = *(const double *)b;
+
+	return x < y ? -1 : x > y;
 }
 
 void
@@ -203,22 +701,55 @@ closefifo(void) {
 	close(infd);
 }
 
+void
+closeimage(SwtWindow *w, SwtText *t) {
+	munmap((void *)t->img->pixels, (size_t)t->img->w * t->img->h * 4);
+	drw_img_free(w->drw, t->img);
+	close(t->imgfd);
+	t->img = NULL;
+}
+
 void
 closewindow(const Arg *arg) {
 	if(sel < 0) return;
-	XDestroyWindow(dpy, windows[sel]->win);
+	/* closed by swt itself, the window can serve another window command */
+	if(!headless)
+		XUnmapWindow(windows[sel]->disp->dpy, windows[sel]->win);
+	destroywindow(sel, True);
 }
 
 
+/* moves the strings still referenced into a fresh arena */
+void
+compactarena(SwtWindow *w) {
+	Arena a;
+	SwtText *t;
+
+	memset(&a, 0, sizeof(a));
+	w->name = intern(&a, w->name->s, w->name->len);
+	w->title = intern(&a, w->title->s, w->title->len);
+	for(int i=0;i<w->nregions;i++) {
+		t = arenaalloc(&a, sizeof(*t));
+		*t = *w->regions[i];
+		t->name = intern(&a, t->name->s, t->name->len);
+		if(t->clock)
+			t->clock = intern(&a, t->clock->s, t->clock->len);
+		w->regions[i] = t;
+	}
+	freearena(&w->arena);
+	w->arena = a;
+}
+
 void
 configurenotify(const XEvent *e) {
 	const XConfigureEvent *ev = &e->xconfigure;
 
-	int w = getwindow(ev->window);
+	int w = getwindow(ev->display, ev->window);
 
-	if(w > -1 && (ev->width != windows[w]->drw->w || ev->height != windows[w]->drw->h)) {
-		drw_resize(windows[w]->drw, ev->width, ev->height);
-		resize(windows[w]);
+	/* only remember the latest geometry, updatewindows() applies it */
+	if(w > -1) {
+		windows[w]->cw = ev->width;
+		windows[w]->ch = ev->height;
 	}
 }
 
@@ -246,116 +777,418 @@ createout(void) {
 	}
 }
 
+double
+cputime(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+	return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+/* names a window of the current display's pool, or a new one when the
+ * pool is empty */
 SwtWindow *
 createwindow(char *name, char *title, Bool hlayout) {
 	XClassHint class_hint;
 	XTextProperty xtp;
-	SwtWindow *swtwin;
-
-	swtwin = emallocz(sizeof(*swtwin));
-
-	swtwin->nregions = 0;
-	swtwin->sel = 0;
+	SwtWindow *swtwin = NULL;
+
+	for(int i=0;i<npool;i++) {
+		if(pool[i]->disp == disp) {
+			swtwin = pool[i];
+			npool--;
+			memmove(&pool[i], &pool[i + 1], sizeof(SwtWindow *) * (npool - i));
+			refill = True;
+			/* pooled windows wait without a pixmap */
+			sizewindow(swtwin);
+			break;
+		}
+	}
+	if(!swtwin)
+		swtwin = newwindow(disp);
 	swtwin->layout = hlayout ? HorizLayout : VertLayout;
-	swtwin->drw = drw_create(dpy, screen, root, DisplayWidth(dpy, screen), DisplayHeight(dpy, screen));
-	swtwin->fnt = drw_font_create(dpy, font);
-	drw_setfont(swtwin->drw, swtwin->fnt);
 
-	swtwin->win = XCreateSimpleWindow(dpy, root, 0, 0, swtwin->drw->w, swtwin->drw->h, 0,
-			scheme[SchemeNorm].fg->rgb, scheme[SchemeNorm].bg->rgb);
-	XSelectInput(dpy, swtwin->win, KeyPressMask|ButtonPressMask|StructureNotifyMask|FocusChangeMask|ExposureMask);
+	if(!headless) {
+		class_hint.res_name = name;
+		class_hint.res_class = "SWT";
+		XSetClassHint(disp->dpy, swtwin->win, &class_hint);
 
-	class_hint.res_name = name;
-	class_hint.res_class = "SWT";
-	XSetClassHint(dpy, swtwin->win, &class_hint);
-
-	if(XmbTextListToTextProperty(dpy, (char **)&title, 1, XUTF8StringStyle,
-				&xtp) == Success) {
-		XSetTextProperty(dpy, swtwin->win, &xtp, XA_WM_NAME);
-		XFree(xtp.value);
+		if(XmbTextListToTextProperty(disp->dpy, (char **)&title, 1, XUTF8StringStyle,
+					&xtp) == Success) {
+			XSetTextProperty(disp->dpy, swtwin->win, &xtp, XA_WM_NAME);
+			XFree(xtp.value);
+		}
 	}
 
-	strncpy(swtwin->name, name, sizeof(swtwin->name)-1);
-	swtwin->name[sizeof(swtwin->name)-1] = '\0';
-	strncpy(swtwin->title, title, sizeof(swtwin->title)-1);
-	swtwin->title[sizeof(swtwin->title)-1] = '\0';
+	swtwin->name = intern(&swtwin->arena, name, strlen(name));
+	swtwin->title = intern(&swtwin->arena, title, strlen(title));
 
 	nwindows++;
 	windows = erealloc(windows, sizeof(SwtWindow *) * nwindows);
 
 	windows[nwindows - 1] = swtwin;
+	if(watchall) {
+		swtwin->watched = True;
+		swtwin->changes |= ChgAdded;
+		watchpending = True;
+	}
+
+	if(nwindows == 1)
+		phase("first window");
+
+	return swtwin;
+}
+
+/* a blank unmapped window on d, createwindow() names it */
+SwtWindow *
+newwindow(SwtDisplay *d) {
+	SwtWindow *swtwin;
+
+	swtwin = emallocz(sizeof(*swtwin));
 
+	swtwin->disp = d;
+	swtwin->nregions = 0;
+	swtwin->sel = 0;
+	if(headless)
+		swtwin->drw = drw_create(NULL, 0, 0, headlesswidth, headlessheight);
+	else
+		swtwin->drw = drw_create(d->dpy, d->screen, d->root,
+				DisplayWidth(d->dpy, d->screen), DisplayHeight(d->dpy, d->screen));
+	drw_setfont(swtwin->drw, getfont(d));
+	swtwin->cw = swtwin->drw->w;
+	swtwin->ch = swtwin->drw->h;
+	swtwin->dirty = True;
+	swtwin->damage = XCreateRegion();
+	/* nothing tells a headless window it is shown */
+	swtwin->mapped = headless;
+
+	if(headless) {
+		swtwin->win = ++lastxid;
+	} else {
+		swtwin->win = XCreateSimpleWindow(d->dpy, d->root, 0, 0, swtwin->drw->w, swtwin->drw->h, 0,
+				getscheme(d, SchemeNorm)->fg->rgb, getscheme(d, SchemeNorm)->bg->rgb);
+		XDefineCursor(d->dpy, swtwin->win, getcursor(d, CurNormal)->cursor);
+		XSelectInput(d->dpy, swtwin->win, KeyPressMask|ButtonPressMask|StructureNotifyMask|FocusChangeMask|ExposureMask|VisibilityChangeMask);
+		/* the xid is valid for other clients once it is handed out */
+		XSync(d->dpy, False);
+	}
 	return swtwin;
 }
 
+/* repaints region i into the pixmap, updatewindows() copies it out */
+void
+damageregion(SwtWindow *w, int i) {
+	damagespan(w, i, 0);
+}
+
+/* input regions are only repainted from byte from on, what is before
+ * it did not move */
+void
+damagespan(SwtWindow *w, int i, unsigned int from) {
+	SwtText *t = w->regions[i];
+	XRectangle r;
+	int x;
+
+	if(w->dirty)
+		return;
+	x = drawregion(w, i, from);
+	r.x = x;
+	r.y = t->r.y;
+	r.width = t->r.x + t->r.w - x;
+	r.height = t->r.h;
+	XUnionRectWithRegion(&r, w->damage, w->damage);
+}
+
 void
 destroynotify(const XEvent *e) {
 	const XDestroyWindowEvent *ev = &e->xdestroywindow;
-	int w = getwindow(ev->window);
-
-	if(!nwindows) {
-		return;
-	} else if(w == 0) {
-		/* First client. */
-		nwindows--;
-		cleanupwindow(windows[0]);
-		memmove(&windows[0], &windows[1], sizeof(SwtWindow *) * nwindows);
-	} else if(w == nwindows - 1) {
-		/* Last client. */
-		nwindows--;
-		cleanupwindow(windows[w]);
-		windows = erealloc(windows, sizeof(SwtWindow *) * nwindows);
-	} else {
-		/* Somewhere inbetween. */
-		cleanupwindow(windows[w]);
-		memmove(&windows[w], &windows[w+1],
-				sizeof(SwtWindow *) * (nwindows - (w + 1)));
-		nwindows--;
+
+	destroywindow(getwindow(ev->display, ev->window), False);
+}
+
+/* recycle is set when swt closed the window itself and it still exists */
+void
+destroywindow(int w, Bool recycle) {
+	SwtWindow *sw;
+
+	if(!nwindows || w < 0) {
+		return;
+	}
+
+	sw = windows[w];
+	if(sw->watched) {
+		dumpwindow(sw, "removed");
+		fflush(outfile);
 	}
+	canceltimers(0, sw);
+	nwindows--;
+	memmove(&windows[w], &windows[w + 1], sizeof(SwtWindow *) * (nwindows - w));
+	if(sel == w)
+		sel = -1;
+	else if(sel > w)
+		sel--;
+
+	if(recycle && recyclewindow(sw))
+		return;
+	if(recycle && !headless)
+		XDestroyWindow(sw->disp->dpy, sw->win);
+	cleanupwindow(sw);
 }
 
+/* hidden windows are only marked, they are painted once they show again */
 void
 draw(SwtWindow *w) {
-	writeout("drawing window xid=%lu name=%s title=%s width=%lu height=%lu\n",
-			w->win, w->name, w->title, w->drw->w, w->drw->h);
+	if(!VISIBLE(w)) {
+		w->dirty = True;
+		return;
+	}
+	paint(w);
+}
 
-	XSetForeground(w->drw->dpy, w->drw->gc, scheme[SchemeNorm].bg->rgb);
-	XFillRectangle(w->drw->dpy, w->drw->drawable, w->drw->gc, 0, 0, w->drw->w, w->drw->h);
+/* paints input region t from byte from on, all of it unless from is
+ * past the first byte shown, returns the x painting started at */
+int
+drawinput(SwtWindow *w, SwtText *t, unsigned int from) {
+	Input *in = t->input;
+	Fnt *f = w->drw->font;
+	unsigned int len = GAPLEN(in), p, n, cw, blen = 0;
+	int x, x0, tx, cx = -1, right = t->r.x + t->r.w - f->h / 2;
+	char buf[256], c[4];
+
+	x = t->r.x + f->h / 2;
+	for(p = in->scroll; p < from && p < len && x < right; p += n) {
+		n = inputchar(in, p, c);
+		x += drw_font_advance(f, c, n);
+	}
+	x0 = p > in->scroll ? x : t->r.x;
+	tx = x;
+	drw_fill(w->drw, x0, t->r.y, t->r.x + t->r.w - x0, t->r.h, w->drw->scheme->bg);
+	for(; p < len; p += n) {
+		if(p == in->cursor)
+			cx = x;
+		n = inputchar(in, p, c);
+		cw = drw_font_advance(f, c, n);
+		if(x + (int)cw > right)
+			break;
+		/* narrow glyphs fill buf before the line, draw it in pieces */
+		if(blen + n > sizeof(buf)) {
+			drw_string(w->drw, tx, t->r.y, right - tx, t->r.h, buf, blen);
+			tx = x;
+			blen = 0;
+		}
+		memcpy(buf + blen, c, n);
+		blen += n;
+		x += cw;
+	}
+	if(p == in->cursor)
+		cx = x;
+	drw_string(w->drw, tx, t->r.y, right > tx ? right - tx : 0, t->r.h, buf, blen);
+	/* the caret marks the region a window in INSERT mode edits */
+	if(cx >= 0 && w->inserting && w->sel < w->nregions && w->regions[w->sel] == t)
+		drw_fill(w->drw, cx, t->r.y + (t->r.h > (int)f->h ? (t->r.h - (int)f->h) / 2 : 0),
+				1, MIN(f->h, (unsigned int)t->r.h), w->drw->scheme->fg);
+	return x0;
+}
 
-	for (int i=0;i<w->nregions;i++) {
-	int filled = 0, empty = 0;
-		if(w->sel == i) {
-			drw_setscheme(w->drw, &scheme[SchemeSel]);
-			filled = 1;
-		} else {
-			drw_setscheme(w->drw, &scheme[SchemeNorm]);
-			empty = 1;
+/* from is the first byte of an input region that changed, returns the
+ * x repainting started at */
+int
+drawregion(SwtWindow *w, int i, unsigned int from) {
+	SwtText *t = w->regions[i];
+	ClrScheme s;
+	int filled = 0, empty = 0, x = t->r.x;
+	unsigned int lh, start, end;
+
+	if(w->sel == i) {
+		s = *getscheme(w->disp, SchemeSel);
+		filled = 1;
+	} else {
+		s = *getscheme(w->disp, SchemeNorm);
+		empty = 1;
+	}
+	if(t->color >= 0)
+		s.fg = drw_clr_rgb(w->drw, t->color);
+	if(t->blinkoff)
+		s.fg = s.bg;
+	drw_setscheme(w->drw, &s);
+	if(checkimage(w, t)) {
+		drw_fill(w->drw, t->r.x, t->r.y, t->r.w, t->r.h, s.bg);
+		drw_img(w->drw, t->r.x, t->r.y, t->img, 0, 0, t->r.w, t->r.h);
+	} else if(t->input) {
+		if(scrollinput(w, t))
+			from = 0;
+		x = drawinput(w, t, from);
+	} else if(t->wrap) {
+		lh = w->drw->font->h;
+		if(t->wrapw != wrapwidth(w, t))
+			wraptext(w, t, wrapwidth(w, t), 0);
+		drw_fill(w->drw, t->r.x, t->r.y, t->r.w, t->r.h, s.bg);
+		for(unsigned int l = 0; l < t->nlines && (int)((l + 1) * lh) <= t->r.h; l++) {
+			start = t->lines[l];
+			end = l + 1 < t->nlines ? t->lines[l + 1] : t->name->len;
+			while(end > start && (t->name->s[end - 1] == ' ' || t->name->s[end - 1] == '\n'))
+				end--;
+			drw_text(w->drw, t->r.x, t->r.y + l * lh, t->r.w, lh, &t->name->s[start], end - start, 0);
 		}
-		drw_text(w->drw, w->regions[i]->r.x, w->regions[i]->r.y, w->regions[i]->r.w, w->regions[i]->r.h, w->regions[i]->name, 0);
-		drw_rect(w->drw, w->regions[i]->r.x, w->regions[i]->r.y, 0, 0, filled, empty, 0);
+	} else
+		drw_text(w->drw, t->r.x, t->r.y, t->r.w, t->r.h, t->name->s, t->name->len, 0);
+	drw_rect(w->drw, t->r.x, t->r.y, 0, 0, filled, empty, 0);
+	drw_setscheme(w->drw, &w->disp->scheme[SchemeNorm]);
+	return x;
+}
+
+void
+dumpjson(int ev, const char *s) {
+	if(!(subscribed & ev))
+		return;
+	fputc('"', outfile);
+	for(; *s; s++) {
+		if(*s == '"' || *s == '\\')
+			fprintf(outfile, "\\%c", *s);
+		else if((unsigned char)*s < 0x20)
+			fprintf(outfile, "\\u%04x", *s);
+		else
+			fputc(*s, outfile);
 	}
+	fputc('"', outfile);
+}
 
-	drw_map(w->drw, w->win, 0, 0, w->drw->w, w->drw->h);
+/* quoted the way nextarg() reads it back */
+void
+dumpquoted(int ev, const char *s) {
+	if(!(subscribed & ev))
+		return;
+	fputc('"', outfile);
+	for(; *s; s++) {
+		if(*s == '"' || *s == '\\')
+			fprintf(outfile, "\\%c", *s);
+		else if(*s == '\n')
+			fputs("\\n", outfile);
+		else if(*s == '\t')
+			fputs("\\t", outfile);
+		else
+			fputc(*s, outfile);
+	}
+	fputc('"', outfile);
 }
 
 void
 dumptree(void) {
 	for(int i=0; i<nwindows;i++) {
-		dumpwindow(windows[i]);
+		dumpwindow(windows[i], "dump");
+		for(int j=0; j<windows[i]->nregions;j++)
+			dumptext(windows[i], j, "dump");
+	}
+	fflush(outfile);
+}
+
+/* the dump and watch writers only buffer, callers flush once per batch,
+ * each line holds outfile so errors of the -t reader can't split it */
+void
+dumptext(SwtWindow *w, int i, const char *ev) {
+	SwtText *t = w->regions[i];
+
+	syncinput(w, t);
+	flockfile(outfile);
+	if(format == FormatJSON) {
+		writepart(EvReply, "{\"event\":\"%s\",\"type\":\"%s\",\"window\":", ev,
+				t->img ? "image" : t->input ? "input" : "text");
+		dumpjson(EvReply, w->name->s);
+		writepart(EvReply, ",\"index\":%d,\"name\":", i);
+		dumpjson(EvReply, t->name->s);
+		writepart(EvReply, ",\"x\":%d,\"y\":%d,\"w\":%d,\"h\":%d", t->r.x, t->r.y, t->r.w, t->r.h);
+		if(t->color >= 0)
+			writepart(EvReply, ",\"color\":\"#%06x\"", t->color);
+		if(t->wrap)
+			writepart(EvReply, ",\"wrap\":true,\"lines\":%u", t->nlines);
+		if(t->input)
+			writepart(EvReply, ",\"cursor\":%u", t->input->cursor);
+		writepart(EvReply, "}\n");
+		funlockfile(outfile);
+		return;
 	}
+
+	if(strcmp(ev, "dump") == 0)
+		writepart(EvReply, "dump %s", t->img ? "image" : t->input ? "input" : "box");
+	else
+		writepart(EvReply, "watch %s %s window=%s index=%d", ev,
+				t->img ? "image" : t->input ? "input" : "box", w->name->s, i);
+	writepart(EvReply, " name=");
+	dumpquoted(EvReply, t->name->s);
+	writepart(EvReply, " w=%d h=%d", t->r.w, t->r.h);
+	if(t->color >= 0)
+		writepart(EvReply, " color=#%06x", t->color);
+	if(t->wrap)
+		writepart(EvReply, " wrap=1 lines=%u", t->nlines);
+	if(t->input)
+		writepart(EvReply, " cursor=%u", t->input->cursor);
+	writepart(EvReply, "\n");
+	funlockfile(outfile);
 }
 
 void
-dumptext(SwtText *w) {
-	writeout("dump %s name=\"%s\" w=%lu h=%lu\n", "box",  w->name, w->r.w, w->r.h);
+dumpwindow(SwtWindow *w, const char *ev) {
+	flockfile(outfile);
+	if(format == FormatJSON) {
+		writepart(EvReply, "{\"event\":\"%s\",\"type\":\"window\",\"xid\":%lu,\"name\":", ev, w->win);
+		dumpjson(EvReply, w->name->s);
+		writepart(EvReply, ",\"title\":");
+		dumpjson(EvReply, w->title->s);
+		writepart(EvReply, ",\"layout\":\"%s\",\"sel\":%d,\"regions\":%d}\n",
+				w->layout == HorizLayout ? "h" : "v", w->sel, w->nregions);
+		funlockfile(outfile);
+		return;
+	}
+
+	if(strcmp(ev, "dump") == 0)
+		writepart(EvReply, "dump window");
+	else
+		writepart(EvReply, "watch %s window", ev);
+	writepart(EvReply, " xid=%lu name=%s title=%s\n", w->win, w->name->s, w->title->s);
+	funlockfile(outfile);
 }
 
+/* replaces del bytes at pos with the n bytes of the '\0' terminated s and
+ * leaves the cursor after them */
 void
-dumpwindow(SwtWindow *w) {
-	writeout("dump window xid=%lu name=%s title=%s\n", w->win, w->name, w->title);
-	for(int i=0; i<w->nregions;i++) {
-		dumptext(w->regions[i]);
+editinput(SwtWindow *w, int i, unsigned int pos, unsigned int del, const char *s, unsigned int n) {
+	SwtText *t = w->regions[i];
+	Input *in = t->input;
+	unsigned int size, tail;
+
+	gapmove(in, pos);
+	in->end += del;
+	if(in->end - in->gap < n) {
+		/* doubling keeps typing amortized O(1) */
+		size = MAX(in->size * 2, GAPLEN(in) + n + 64);
+		in->buf = erealloc(in->buf, size);
+		tail = in->size - in->end;
+		memmove(in->buf + size - tail, in->buf + in->end, tail);
+		in->end = size - tail;
+		in->size = size;
 	}
+	memcpy(in->buf + in->gap, s, n);
+	in->gap += n;
+	in->cursor = pos + n;
+	in->stale = True;
+
+	if(in->live) {
+		flockfile(outfile);
+		if(del)
+			writepart(EvInput, "input %s %d delete %u %u\n", w->name->s, i, pos, del);
+		if(n) {
+			writepart(EvInput, "input %s %d insert %u ", w->name->s, i, pos);
+			dumpquoted(EvInput, s);
+			writepart(EvInput, "\n");
+		}
+		fflush(outfile);
+		funlockfile(outfile);
+	}
+	if(w->watched) {
+		t->changes |= ChgChanged;
+		watchpending = True;
+	}
+	damagespan(w, i, pos);
 }
 
 void *
@@ -379,171 +1212,1239 @@ erealloc(void *o, size_t size) {
 void
 expose(const XEvent *e) {
 	const XExposeEvent *ev = &e->xexpose;
+	XRectangle r;
 	int w;
 
-	if(ev->count == 0) {
-		w = getwindow(ev->window);
-		draw(windows[w]);
+	if((w = getwindow(ev->display, ev->window)) < 0)
+		return;
+
+	r.x = ev->x;
+	r.y = ev->y;
+	r.width = ev->width;
+	r.height = ev->height;
+	XUnionRectWithRegion(&r, windows[w]->damage, windows[w]->damage);
+}
+
+void
+firetimer(Timer *t) {
+	SwtText *r;
+	char *s;
+
+	switch(t->type) {
+	case TimerCommand:
+		/* commands are split in place, keep the original */
+		s = emallocz(strlen(t->command) + 1);
+		strcpy(s, t->command);
+		splitcommand(s, proccommand);
+		free(s);
+		break;
+	case TimerClock:
+		tickclock(t->win, t->region);
+		break;
+	case TimerBlink:
+		r = t->win->regions[t->region];
+		r->blinkoff = !r->blinkoff;
+		damageregion(t->win, t->region);
+		break;
+	}
+}
+
+/* adds one window to the current display's pool per idle loop iteration */
+void
+fillpool(void) {
+	SwtWindow *w;
+	int n = 0;
+
+	for(int i=0;i<npool;i++)
+		if(pool[i]->disp == disp)
+			n++;
+	if(n >= (int)windowpool) {
+		refill = False;
+		return;
 	}
+	pool = erealloc(pool, sizeof(SwtWindow *) * (npool + 1));
+	pool[npool++] = w = newwindow(disp);
+	/* idle windows would hold a screen sized pixmap outside hiddenbudget */
+	drw_release(w->drw);
+	w->released = True;
+	if(n + 1 >= (int)windowpool)
+		refill = False;
 }
 
 void
 focusin(const XEvent *e) {
 	const XFocusChangeEvent *ev = &e->xfocus;
-	int dummy;
-	Window focused;
 
 	if(ev->mode != NotifyUngrab) {
-		XGetInputFocus(dpy, &focused, &dummy);
-		sel = getwindow(focused);
+		sel = getwindow(ev->display, ev->window);
+		if(sel > -1)
+			writeout(EvFocus, "focus %s %lu\n", windows[sel]->name->s, windows[sel]->win);
 	}
 }
 
-int
-getwindow(Window w) {
-	for(int i=0;i<nwindows;i++) {
-		if(w == windows[i]->win) {
-			return i;
-		}
+void
+freearena(Arena *a) {
+	Block *b, *next;
+
+	for(b = a->blocks; b; b = next) {
+		next = b->next;
+		free(b);
 	}
-	return -1;
+	free(a->strs);
+	memset(a, 0, sizeof(*a));
 }
 
-int
-getwindowc(char *name) {
-	for (int i=0;i<nwindows;i++) {
-		if(strcmp(name, windows[i]->name) == 0) {
-			return i;
-		}
+/* moves the gap of in to byte pos, the bytes in between change sides */
+void
+gapmove(Input *in, unsigned int pos) {
+	unsigned int n;
+
+	if(pos < in->gap) {
+		n = in->gap - pos;
+		memmove(in->buf + in->end - n, in->buf + pos, n);
+		in->gap -= n;
+		in->end -= n;
+	} else if(pos > in->gap) {
+		n = pos - in->gap;
+		memmove(in->buf + in->gap, in->buf + in->end, n);
+		in->gap += n;
+		in->end += n;
 	}
-	return -1;
 }
 
-void
-keypress(const XEvent *e) {
-	const XKeyEvent *ev = &e->xkey;
-	unsigned int i;
-	KeySym keysym;
+/* returns the arena's copy of s, equal strings are stored only once */
+Str *
+intern(Arena *a, const char *s, size_t len) {
+	Str **old, *str;
+	unsigned int h = strhash(s, len), i, j, oldsize;
 
-	keysym = XkbKeycodeToKeysym(dpy, (KeyCode)ev->keycode, 0, 0);
-	for(i = 0; i < LENGTH(keys); i++) {
-		if(keysym == keys[i].keysym
-				&& CLEANMASK(keys[i].mod) == CLEANMASK(ev->state)
-				&& keys[i].func) {
-			keys[i].func(&(keys[i].arg));
-		} else if(keysym == XK_Escape) {
-			/* exit INSERT mode */
-		} else {
-			/* insert to selected inputfield */
+	if(a->size) {
+		for(i = h & (a->size - 1); a->strs[i]; i = (i + 1) & (a->size - 1))
+			if(a->strs[i]->len == len && memcmp(a->strs[i]->s, s, len) == 0)
+				return a->strs[i];
+	}
+
+	/* keep the table at most half full */
+	if((a->len + 1) * 2 > a->size) {
+		old = a->strs;
+		oldsize = a->size;
+		a->size = oldsize ? oldsize * 2 : 16;
+		a->strs = emallocz(sizeof(Str *) * a->size);
+		for(i = 0; i < oldsize; i++) {
+			if(!old[i])
+				continue;
+			j = strhash(old[i]->s, old[i]->len) & (a->size - 1);
+			for(; a->strs[j]; j = (j + 1) & (a->size - 1));
+			a->strs[j] = old[i];
 		}
+		free(old);
 	}
-}
 
-void
-noop(void) {
-	time_t t;
+	str = arenaalloc(a, sizeof(Str) + len + 1);
+	str->len = len;
+	memcpy(str->s, s, len);
+	str->s[len] = '\0';
 
-	t = time(NULL);
-	writeout("NOOP %lu\n", t);
+	for(i = h & (a->size - 1); a->strs[i]; i = (i + 1) & (a->size - 1));
+	a->strs[i] = str;
+	a->len++;
+	return str;
 }
 
-void
-procinput(void) {
-	size_t len = -1;
-	char *input;
-	char buf[PIPE_BUF];
+/* copies the character at byte p to c, returns its length */
+unsigned int
+inputchar(Input *in, unsigned int p, char *c) {
+	unsigned int n = 0, len = GAPLEN(in);
 
-	if((len = read(infd, buf, PIPE_BUF)) == -1) {
-		perror("swt failed to read from pipe");
-	}
+	do {
+		c[n] = GAPAT(in, p + n);
+		n++;
+	} while(n < 4 && p + n < len && (GAPAT(in, p + n) & 0xc0) == 0x80);
+	return n;
+}
 
-	if(len > 0) {
-		buf[len - 1] = '\0';
-	} else {
-		resetfifo();
+/* edits input region i of w, typed is the keysym with shift applied */
+void
+inputkey(SwtWindow *w, int i, KeySym typed) {
+	SwtText *t = w->regions[i];
+	Input *in = t->input;
+	unsigned int pos = in->cursor, len = GAPLEN(in), n;
+	char buf[5], c[4];
+
+	switch(typed) {
+	case XK_Return:
+	case XK_KP_Enter:
+		syncinput(w, t);
+		flockfile(outfile);
+		writepart(EvInput, "input %s %d enter ", w->name->s, i);
+		dumpquoted(EvInput, t->name->s);
+		writeout(EvInput, "\n");
+		funlockfile(outfile);
+		/* every enter leaves the previous text behind */
+		if(w->arena.dead * 2 > w->arena.used)
+			compactarena(w);
+		return;
+	case XK_Left:
+		setcursor(w, i, prevchar(in, pos));
+		return;
+	case XK_Right:
+		if(pos < len)
+			setcursor(w, i, pos + inputchar(in, pos, c));
 		return;
+	case XK_Home:
+		setcursor(w, i, 0);
+		return;
+	case XK_End:
+		setcursor(w, i, len);
+		return;
+	case XK_BackSpace:
+		if(pos > 0) {
+			n = prevchar(in, pos);
+			editinput(w, i, n, pos - n, "", 0);
+		}
+		return;
+	case XK_Delete:
+		if(pos < len)
+			editinput(w, i, pos, inputchar(in, pos, c), "", 0);
+		return;
+	}
+	if((n = keytext(typed, buf))) {
+		buf[n] = '\0';
+		editinput(w, i, pos, 0, buf, n);
 	}
+}
 
-	for(input = buf;;input = NULL) {
-		char *command = NULL, *attributes = NULL;
+void *
+inputthread(void *arg) {
+	struct pollfd fds[2];
+	uint64_t v = 1;
 
-		command = strtok(input, ";");
-		if(command == NULL)
+	for(;;) {
+		fds[0].fd = infd;
+		fds[0].events = POLLIN;
+		fds[1].fd = stopfd;
+		fds[1].events = POLLIN;
+
+		if(poll(fds, 2, -1) == -1) {
+			if(errno == EINTR)
+				continue;
+			perror("swt error on poll()");
 			break;
-
-		if((attributes = strchr(command, ' '))) {
-			*(attributes++) = '\0';
-		} else {
-			if(strcasecmp("noop", command) == 0) {
-				noop();
-			} else if(strcasecmp("dump", command) == 0) {
-				dumptree();
-			} else if(strcasecmp("quit", command) == 0) {
-				quit(NULL);
-			} else if(strcasecmp("window", command) == 0) {
-				procwindow(NULL, true); /* defaul horizontal */
-			} else if(strcasecmp("hwindow", command) == 0) {
-				procwindow(NULL, true);
-			} else if(strcasecmp("vwindow", command) == 0) {
-				procwindow(NULL, false);
-			} else
-				writeout("ERROR parsing command: %s\n", command);
-			continue;
 		}
-
-		if(strcasecmp("window", command) == 0) {
-			procwindow(attributes, true); /* default horizontal */
-		} else if(strcasecmp("hwindow", command) == 0) {
-			procwindow(attributes, true);
-		} else if(strcasecmp("vwindow", command) == 0) {
-			procwindow(attributes, false);
-		} else if(strcasecmp("add", command) == 0) {
-			procadd(attributes);
-		} else if(strcasecmp("show", command) == 0) {
-			procshow(attributes);
-		} else if(strcasecmp("remove", command) == 0) {
-			procremove(attributes);
-		} else {
-			writeout("ERROR unknown command: %s(%s)\n", command, attributes);
+		if(fds[1].revents)
+			break;
+		if(fds[0].revents) {
+			readinput(queuecommand);
+			if(write(evfd, &v, sizeof(v)) == -1)
+				perror("swt failed to write to eventfd");
 		}
-		fflush(NULL);
 	}
+	return NULL;
 }
 
+/* stops painting w until it shows again, called before it is hidden */
 void
-procadd(char *attrs) {
-	char *parent = NULL, *wtype = NULL, *wattrs = NULL;
-
-	parent = attrs ? attrs : "swt";
+hidewindow(SwtWindow *w) {
+	if(!VISIBLE(w))
+		return;
+	w->dirty = True;
+	w->hidden = ++lasthidden;
+	trim = True;
+}
 
-	if(attrs && (wtype = strchr(attrs, ' '))) {
-		*(wtype++) = '\0';
-	}
-	/* find parent widget/window or error and return */
-	int w = getwindowc(parent);
+/* keys go to the selected region until Escape, if it is an input */
+void
+insertmode(const Arg *arg) {
+	SwtWindow *w;
 
-	if(w < 0) {
-		writeout("ERROR window/widget \"%s\" not found\n", parent);
+	if(sel < 0)
 		return;
-	}
+	w = windows[sel];
+	if(w->sel >= w->nregions || !w->regions[w->sel]->input)
+		return;
+	w->inserting = True;
+	damageregion(w, w->sel);
+}
 
-	if (wtype && (wattrs = strchr(wtype, ' '))) {
-		*(wattrs++) = '\0';
-	}
+Cur *
+getcursor(SwtDisplay *d, int c) {
+	static const int shapes[CurLast] = {
+		[CurNormal] = XC_left_ptr,
+		[CurResize] = XC_sizing,
+		[CurMove]   = XC_fleur,
+	};
+
+	if(!d->cursor[c])
+		d->cursor[c] = drw_cur_create(d->drw, shapes[c]);
+	return d->cursor[c];
+}
 
-	if(strcasecmp("text", wtype) == 0) {
-		addtext(windows[w], wattrs);
-	} else {
-		writeout("ERROR unknown widget type: %s\n", wtype);
-	}
+Fnt *
+getfont(SwtDisplay *d) {
+	/* font sets are expensive to load, the windows of a display share one */
+	if(!d->font)
+		d->font = drw_font_create(d->dpy, font);
+	return d->font;
+}
+
+ClrScheme *
+getscheme(SwtDisplay *d, int s) {
+	const char *clrnames[SchemeLast][3] = {
+		[SchemeNorm] = { normfgcolor, normbgcolor, normbordercolor },
+		[SchemeSel]  = { selfgcolor, selbgcolor, selbordercolor },
+	};
+	Clr *clrs[3];
+
+	if(!d->scheme[s].fg) {
+		drw_clrs_create(d->drw, clrnames[s], clrs, LENGTH(clrs));
+		d->scheme[s].fg     = clrs[0];
+		d->scheme[s].bg     = clrs[1];
+		d->scheme[s].border = clrs[2];
+	}
+	return &d->scheme[s];
+}
+
+/* xids are only unique per server, a NULL dpy takes the first match */
+int
+getwindow(Display *dpy, Window w) {
+	for(int i=0;i<nwindows;i++) {
+		if(w == windows[i]->win && (!dpy || dpy == windows[i]->disp->dpy)) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+int
+getwindowc(char *name) {
+	for (int i=0;i<nwindows;i++) {
+		if(strcmp(name, windows[i]->name->s) == 0) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+/* look a window up by name, falling back to its xid */
+int
+getwindowh(char *handle) {
+	char *end;
+	unsigned long xid;
+	int w;
+
+	if((w = getwindowc(handle)) > -1)
+		return w;
+	xid = strtoul(handle, &end, 0);
+	if(*handle && !*end)
+		return getwindow(NULL, xid);
+	return -1;
+}
+
+void
+handlekey(int w, KeySym keysym, KeySym typed, unsigned int state) {
+	SwtWindow *win = w > -1 ? windows[w] : NULL;
+	unsigned int i;
+	const char *name;
+	char hex[2 + sizeof(KeySym) * 2 + 1];
+
+	if((subscribed & EvKey) && win) {
+		/* NoSymbol and unnamed keysyms have no string */
+		if(!(name = XKeysymToString(keysym))) {
+			snprintf(hex, sizeof(hex), "0x%lx", (unsigned long)keysym);
+			name = hex;
+		}
+		writeout(EvKey, "key %s %s %u\n", win->name->s, name, state);
+	}
+	/* in INSERT mode the keys without MODKEY edit the selected input */
+	if(win && win->inserting && win->sel < win->nregions && win->regions[win->sel]->input
+	&& !CLEANMASK(state)) {
+		if(keysym == XK_Escape) {
+			win->inserting = False;
+			damageregion(win, win->sel);
+		} else
+			inputkey(win, win->sel, typed);
+		return;
+	}
+	for(i = 0; i < LENGTH(keys); i++) {
+		if(keysym == keys[i].keysym
+				&& CLEANMASK(keys[i].mod) == CLEANMASK(state)
+				&& keys[i].func) {
+			keys[i].func(&(keys[i].arg));
+		}
+	}
+}
+
+void
+keypress(const XEvent *e) {
+	const XKeyEvent *ev = &e->xkey;
+
+	/* bindings match the unshifted keysym, typing takes the shifted one */
+	handlekey(getwindow(ev->display, ev->window),
+			XkbKeycodeToKeysym(ev->display, (KeyCode)ev->keycode, 0, 0),
+			XkbKeycodeToKeysym(ev->display, (KeyCode)ev->keycode, 0, (ev->state & ShiftMask) ? 1 : 0),
+			ev->state);
+}
+
+/* writes the UTF-8 keysym types to buf, returns its length or 0 */
+unsigned int
+keytext(KeySym keysym, char *buf) {
+	unsigned long c;
+
+	if((keysym >= 0x20 && keysym <= 0x7e) || (keysym >= 0xa0 && keysym <= 0xff))
+		c = keysym;
+	else if((keysym & 0xff000000) == 0x01000000)
+		c = keysym & 0x00ffffff; /* Unicode keysyms */
+	else
+		return 0;
+
+	if(c < 0x80) {
+		buf[0] = c;
+		return 1;
+	}
+	if(c < 0x800) {
+		buf[0] = 0xc0 | c >> 6;
+		buf[1] = 0x80 | (c & 0x3f);
+		return 2;
+	}
+	if(c >= 0xd800 && c < 0xe000)
+		return 0; /* surrogates */
+	if(c < 0x10000) {
+		buf[0] = 0xe0 | c >> 12;
+		buf[1] = 0x80 | (c >> 6 & 0x3f);
+		buf[2] = 0x80 | (c & 0x3f);
+		return 3;
+	}
+	if(c < 0x110000) {
+		buf[0] = 0xf0 | c >> 18;
+		buf[1] = 0x80 | (c >> 12 & 0x3f);
+		buf[2] = 0x80 | (c >> 6 & 0x3f);
+		buf[3] = 0x80 | (c & 0x3f);
+		return 4;
+	}
+	return 0;
+}
+
+/* reads a -R recording, it stays loaded until exit */
+void
+loadreplay(const char *path) {
+	struct stat st;
+	char *buf, *p, *end;
+	double first = 0;
+	ssize_t n;
+	Record *r;
+	int fd;
+
+	if((fd = open(path, O_RDONLY)) == -1 || fstat(fd, &st) == -1)
+		die("swt unable to open recording: %s\n", path);
+	buf = emallocz(st.st_size + 1);
+	for(off_t got = 0; got < st.st_size; got += n)
+		if((n = read(fd, buf + got, st.st_size - got)) <= 0)
+			die("swt unable to read recording: %s\n", path);
+	close(fd);
+
+	/* <ms> <client> <length> <command bytes>\n */
+	end = buf + st.st_size;
+	for(p = buf; p < end; p = (char *)r->cmd + r->len + 1) {
+		if(!(nrecords & (nrecords - 1)))
+			records = erealloc(records, sizeof(Record) * (nrecords ? nrecords * 2 : 1));
+		r = &records[nrecords++];
+		r->at = strtod(p, &p);
+		r->client = strtoul(p, &p, 10);
+		r->len = strtoul(p, &p, 10);
+		if(*p != ' ' || r->len > (size_t)(end - p - 1) || p[1 + r->len] != '\n')
+			die("swt malformed recording: %s\n", path);
+		r->cmd = p + 1;
+		if(nrecords == 1)
+			first = r->at;
+		r->at -= first;
+	}
+	/* nothing to wait for, replay() is never reached to end the run */
+	if(!nrecords && !in)
+		running = False;
+	replaystart = uptime();
+	replayframes = nframes;
+}
+
+void
+mapnotify(const XEvent *e) {
+	const XMapEvent *ev = &e->xmap;
+	int w;
+
+	if((w = getwindow(ev->display, ev->window)) > -1)
+		windows[w]->mapped = True;
+}
+
+/* w selects by window, otherwise id by id, otherwise all */
+Bool
+matchtimer(const Timer *t, unsigned long id, SwtWindow *w) {
+	if(w)
+		return t->win == w;
+	return !id || t->id == id;
+}
+
+/* ms until the next recorded command is due, -1 if there is none */
+long
+nextrecord(void) {
+	double ms;
+
+	if(nplayed >= nrecords)
+		return -1;
+	if(speed <= 0)
+		return 0;
+	ms = records[nplayed].at / speed - (uptime() - replaystart);
+	return ms > 0 ? (long)ms + 1 : 0;
+}
+
+/* ms until the next tick with timers due or with coarser timers to
+ * cascade, -1 without timers */
+long
+nexttimer(void) {
+	struct timespec now;
+	uint64_t t;
+	long ms;
+
+	if(!ntimers)
+		return -1;
+	for(t = wheeltick; t == wheeltick || t & (WHEELSIZE - 1); t++)
+		if(wheel[0][t & (WHEELSIZE - 1)])
+			break;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	ms = (long)(t * TICK) - ((now.tv_sec - tstart.tv_sec) * 1000 + (now.tv_nsec - tstart.tv_nsec) / 1000000);
+	return MAX(ms, 0);
+}
+
+/* maps the pixels of t, named by t->name, read-only */
+Bool
+openimage(SwtWindow *w, SwtText *t, unsigned int iw, unsigned int ih) {
+	struct stat st;
+	size_t len = (size_t)iw * ih * 4;
+	void *map;
+	int fd;
+
+	/* paths have a slash past the first byte, "/name" is shm */
+	if(t->name->len && strchr(t->name->s + 1, '/'))
+		fd = open(t->name->s, O_RDONLY);
+	else
+		fd = shm_open(t->name->s, O_RDONLY, 0);
+	if(fd == -1 || fstat(fd, &st) == -1) {
+		writeout(EvError, "ERROR unable to open image \"%s\": %s\n", t->name->s, strerror(errno));
+		if(fd != -1)
+			close(fd);
+		return False;
+	}
+	if((size_t)st.st_size < len) {
+		writeout(EvError, "ERROR image \"%s\" is smaller than %ux%u\n", t->name->s, iw, ih);
+		close(fd);
+		return False;
+	}
+	map = mmap(NULL, len, PROT_READ, MAP_SHARED, fd, 0);
+	if(map == MAP_FAILED) {
+		writeout(EvError, "ERROR unable to map image \"%s\": %s\n", t->name->s, strerror(errno));
+		close(fd);
+		return False;
+	}
+	if(!(t->img = drw_img_create(w->drw, map, iw, ih))) {
+		writeout(EvError, "ERROR images need a 24 bit TrueColor visual\n");
+		munmap(map, len);
+		close(fd);
+		return False;
+	}
+	/* kept to see the client shrink the file under the mapping */
+	t->imgfd = fd;
+	return True;
+}
+
+/* returns the display called name, NULL is the default one */
+SwtDisplay *
+opendisplay(const char *name) {
+	Display *dpy = NULL;
+	SwtDisplay *d;
+
+	for(int i=0;i<ndisplays;i++)
+		if(name && strcmp(name, displays[i]->name) == 0)
+			return displays[i];
+	if(!headless && !(dpy = XOpenDisplay(name)))
+		return NULL;
+	if(dpy) {
+		/* the same server may have been asked for under another name */
+		name = DisplayString(dpy);
+		for(int i=0;i<ndisplays;i++) {
+			if(strcmp(name, displays[i]->name) == 0) {
+				XCloseDisplay(dpy);
+				return displays[i];
+			}
+		}
+	} else if(!name)
+		name = "headless";
+
+	d = emallocz(sizeof(SwtDisplay) + strlen(name) + 1);
+	strcpy(d->name, name);
+	d->dpy = dpy;
+	if(dpy) {
+		d->screen = DefaultScreen(dpy);
+		d->root = RootWindow(dpy, d->screen);
+	}
+	/* cursors, colors and the font are created on first use or by
+	 * warmup() once the input is being served */
+	d->drw = drw_create(dpy, d->screen, d->root, 1, 1);
+
+	ndisplays++;
+	displays = erealloc(displays, sizeof(SwtDisplay *) * ndisplays);
+	displays[ndisplays - 1] = d;
+	return d;
+}
+
+/* cuts the next argument off *s, or all that is left if rest is set.
+ * Quotes group words and are dropped, a backslash escapes the next
+ * byte, \n and \t stand for newline and tab.  Decoded in place, *s
+ * is left at the next argument, NULL is returned when nothing is left */
+char *
+nextarg(char **s, Bool rest) {
+	char *r, *w, *arg, quote = 0;
+
+	if(!*s)
+		return NULL;
+	for(r = *s; *r == ' ' || *r == '\t'; r++);
+	if(!*r) {
+		*s = r;
+		return NULL;
+	}
+	for(arg = w = r; *r; r++) {
+		if(*r == '\\' && r[1]) {
+			r++;
+			*w++ = *r == 'n' ? '\n' : *r == 't' ? '\t' : *r;
+		} else if(quote ? *r == quote : (*r == '"' || *r == '\'')) {
+			quote = quote ? 0 : *r;
+		} else if(!quote && !rest && (*r == ' ' || *r == '\t')) {
+			while(*++r == ' ' || *r == '\t');
+			break;
+		} else {
+			*w++ = *r;
+		}
+	}
+	*w = '\0';
+	*s = r;
+	return arg;
+}
+
+void
+noop(void) {
+	time_t t;
+
+	t = time(NULL);
+	writeout(EvReply, "NOOP %lu\n", t);
+}
+
+void
+proccommand(char *command, char *attributes) {
+	double t0 = timings ? cputime() : 0;
+
+	execcommand(command, attributes);
+	if(timings)
+		tcommand += cputime() - t0;
+}
+
+void
+execcommand(char *command, char *attributes) {
+	if(!attributes) {
+		if(strcasecmp("noop", command) == 0) {
+			noop();
+		} else if(strcasecmp("display", command) == 0) {
+			procdisplay(NULL);
+		} else if(strcasecmp("dump", command) == 0) {
+			dumptree();
+		} else if(strcasecmp("unwatch", command) == 0) {
+			procwatch("all", False);
+		} else if(strcasecmp("quit", command) == 0) {
+			quit(NULL);
+		} else if(strcasecmp("window", command) == 0) {
+			procwindow(NULL, true); /* defaul horizontal */
+		} else if(strcasecmp("hwindow", command) == 0) {
+			procwindow(NULL, true);
+		} else if(strcasecmp("vwindow", command) == 0) {
+			procwindow(NULL, false);
+		} else
+			writeout(EvError, "ERROR parsing command: %s\n", command);
+		return;
+	}
+
+	if(strcasecmp("window", command) == 0) {
+		procwindow(attributes, true); /* default horizontal */
+	} else if(strcasecmp("hwindow", command) == 0) {
+		procwindow(attributes, true);
+	} else if(strcasecmp("vwindow", command) == 0) {
+		procwindow(attributes, false);
+	} else if(strcasecmp("add", command) == 0) {
+		procadd(attributes);
+	} else if(strcasecmp("cancel", command) == 0) {
+		proccancel(attributes);
+	} else if(strcasecmp("capture", command) == 0) {
+		proccapture(attributes);
+	} else if(strcasecmp("color", command) == 0) {
+		proccolor(attributes);
+	} else if(strcasecmp("damage", command) == 0) {
+		procdamage(attributes);
+	} else if(strcasecmp("display", command) == 0) {
+		procdisplay(attributes);
+	} else if(strcasecmp("dump", command) == 0) {
+		procdump(attributes);
+	} else if(strcasecmp("every", command) == 0) {
+		procevery(attributes);
+	} else if(strcasecmp("format", command) == 0) {
+		procformat(attributes);
+	} else if(strcasecmp("key", command) == 0) {
+		prockey(attributes);
+	} else if(strcasecmp("watch", command) == 0) {
+		procwatch(attributes, True);
+	} else if(strcasecmp("unwatch", command) == 0) {
+		procwatch(attributes, False);
+	} else if(strcasecmp("show", command) == 0) {
+		procshow(attributes);
+	} else if(strcasecmp("remove", command) == 0) {
+		procremove(attributes);
+	} else if(strcasecmp("settext", command) == 0) {
+		procsettext(attributes);
+	} else if(strcasecmp("snapshot", command) == 0) {
+		procsnapshot(attributes);
+	} else if(strcasecmp("subscribe", command) == 0) {
+		procsubscribe(attributes);
+	} else {
+		writeout(EvError, "ERROR unknown command: %s(%s)\n", command, attributes);
+	}
+}
+
+/* renders the whole window from its regions and copies it out */
+void
+paint(SwtWindow *w) {
+	double t0 = timings ? cputime() : 0;
+
+	writeout(EvDraw, "drawing window xid=%lu name=%s title=%s width=%u height=%u\n",
+			w->win, w->name->s, w->title->s, w->drw->w, w->drw->h);
+
+	drw_fill(w->drw, 0, 0, w->drw->w, w->drw->h, getscheme(w->disp, SchemeNorm)->bg);
+
+	for (int i=0;i<w->nregions;i++)
+		drawregion(w, i, 0);
+
+	drw_map(w->drw, w->win, 0, 0, w->drw->w, w->drw->h);
+	w->dirty = False;
+
+	if(timings) {
+		pthread_mutex_lock(&statlock);
+		tpaint += cputime() - t0;
+		npaint++;
+		pthread_mutex_unlock(&statlock);
+	}
+}
+
+/* brings the windows of d on screen, returns the frames it painted */
+unsigned long
+paintdisplay(SwtDisplay *d) {
+	SwtWindow *w;
+	unsigned long frames = 0;
+
+	for(int i=0;i<nwindows;i++) {
+		w = windows[i];
+		/* hidden windows stay dirty until they show again */
+		if(w->disp != d || !VISIBLE(w))
+			continue;
+		sizewindow(w);
+		/* pace repaints to the completion of the previous frame */
+		if(w->dirty && drw_busy(w->drw))
+			continue;
+		if(w->uploads)
+			uploadimages(w);
+		if(XEmptyRegion(w->damage)) {
+			if(w->dirty) {
+				draw(w);
+				frames++;
+			}
+			continue;
+		}
+		/* a full paint covers the exposure, otherwise serve it from the pixmap */
+		if(w->dirty)
+			draw(w);
+		else
+			drw_map_region(w->drw, w->win, w->damage);
+		frames++;
+		XDestroyRegion(w->damage);
+		w->damage = XCreateRegion();
+	}
+	return frames;
+}
+
+/* the painter of one display, it only touches that display and its
+ * windows, while the X thread waits in updatewindows() */
+void *
+paintthread(void *arg) {
+	SwtDisplay *d = arg;
+	unsigned long frames;
+
+	pthread_mutex_lock(&paintlock);
+	for(;;) {
+		while(!d->painting && !d->quit)
+			pthread_cond_wait(&paintstart, &paintlock);
+		if(d->quit)
+			break;
+		pthread_mutex_unlock(&paintlock);
+		frames = paintdisplay(d);
+		pthread_mutex_lock(&paintlock);
+		nframes += frames;
+		d->painting = False;
+		if(!--npainting)
+			pthread_cond_signal(&paintdone);
+	}
+	pthread_mutex_unlock(&paintlock);
+	return NULL;
+}
+
+void
+phase(const char *name) {
+	struct timespec now;
+
+	if(!timings)
+		return;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	fprintf(stderr, "swt: %-16s %9.3f ms  (+%.3f ms)\n", name,
+			(now.tv_sec - tstart.tv_sec) * 1e3 + (now.tv_nsec - tstart.tv_nsec) / 1e6,
+			(now.tv_sec - tlast.tv_sec) * 1e3 + (now.tv_nsec - tlast.tv_nsec) / 1e6);
+	tlast = now;
+}
+
+/* returns where the character before byte p starts */
+unsigned int
+prevchar(Input *in, unsigned int p) {
+	while(p > 0) {
+		p--;
+		if((GAPAT(in, p) & 0xc0) != 0x80)
+			break;
+	}
+	return p;
+}
+
+void
+procinput(void) {
+	readinput(proccommand);
+}
+
+void
+procqueue(void) {
+	Command *c;
+	uint64_t v;
+
+	if(read(evfd, &v, sizeof(v)) == -1 && errno != EAGAIN)
+		perror("swt failed to read from eventfd");
+
+	while((c = ringpop())) {
+		proccommand(c->name, c->attrs);
+		free(c);
+	}
+}
+
+void
+procadd(char *attrs) {
+	char *parent, *wtype, *wattrs;
+	int w;
+
+	if(!(parent = nextarg(&attrs, False)))
+		parent = "swt";
+	/* find parent widget/window or error and return */
+	if((w = getwindowc(parent)) < 0) {
+		writeout(EvError, "ERROR window/widget \"%s\" not found\n", parent);
+		return;
+	}
+
+	if(!(wtype = nextarg(&attrs, False))) {
+		writeout(EvError, "ERROR usage: add <parent> <widget>\n");
+		return;
+	}
+	/* the widget takes apart the rest */
+	wattrs = *attrs ? attrs : NULL;
+
+	if(strcasecmp("text", wtype) == 0) {
+		addtext(windows[w], wattrs, WidgetText);
+	} else if(strcasecmp("clock", wtype) == 0) {
+		addtext(windows[w], wattrs, WidgetClock);
+	} else if(strcasecmp("input", wtype) == 0) {
+		addtext(windows[w], wattrs, WidgetInput);
+	} else if(strcasecmp("image", wtype) == 0) {
+		addimage(windows[w], wattrs);
+	} else {
+		writeout(EvError, "ERROR unknown widget type: %s\n", wtype);
+	}
+}
+
+/* cancel <id> */
+void
+proccancel(char *attrs) {
+	char *arg = nextarg(&attrs, True);
+	unsigned long id = arg ? strtoul(arg, NULL, 10) : 0;
+
+	if(!id || !canceltimers(id, NULL))
+		writeout(EvError, "ERROR timer %s not found\n", arg ? arg : "");
+	else
+		writeout(EvReply, "cancel %lu\n", id);
+}
+
+void
+proccapture(char *attrs) {
+	char *handle, *file;
+	int w;
+
+	handle = nextarg(&attrs, False);
+	if(!(file = nextarg(&attrs, True))) {
+		writeout(EvError, "ERROR usage: capture <window> <file>\n");
+		return;
+	}
+	if((w = getwindowh(handle)) < 0) {
+		writeout(EvError, "ERROR window \"%s\" not found\n", handle);
+		return;
+	}
+	/* hidden windows too, their pixmap is brought back if released */
+	sizewindow(windows[w]);
+	if(windows[w]->dirty)
+		paint(windows[w]);
+	if(windows[w]->uploads)
+		uploadimages(windows[w]);
+	if(!drw_capture(windows[w]->drw, file))
+		writeout(EvError, "ERROR unable to capture \"%s\" to \"%s\"\n", handle, file);
+	else
+		writeout(EvReply, "capture %s %s\n", windows[w]->name->s, file);
+}
+
+void
+proccolor(char *attrs) {
+	char *win, *index, *clr;
+	unsigned int rgb;
+	SwtWindow *sw;
+	SwtText *t;
+	int w, i;
+
+	win = nextarg(&attrs, False);
+	index = nextarg(&attrs, False);
+	if(!(clr = nextarg(&attrs, False))) {
+		writeout(EvError, "ERROR usage: color <window> <index> <color>\n");
+		return;
+	}
+
+	if((w = getwindowc(win)) < 0) {
+		writeout(EvError, "ERROR window/widget \"%s\" not found\n", win);
+		return;
+	}
+	sw = windows[w];
+	i = atoi(index);
+	if(i < 0 || i >= sw->nregions) {
+		writeout(EvError, "ERROR region %s not found in \"%s\"\n", index, win);
+		return;
+	}
+	if(!drw_clr_parse(sw->drw, clr, &rgb)) {
+		writeout(EvError, "ERROR invalid color: %s\n", clr);
+		return;
+	}
+
+	t = sw->regions[i];
+	if(t->color == (int)rgb)
+		return;
+	t->color = rgb;
+	if(sw->watched) {
+		t->changes |= ChgChanged;
+		watchpending = True;
+	}
+
+	/* only the region changed, repaint and copy just its rectangle */
+	damageregion(sw, i);
+}
+
+/* damage <window> <index> <x> <y> <w> <h>, the area is uploaded with the
+ * next frame, together with the other damage since the last one */
+void
+procdamage(char *attrs) {
+	char *win;
+	int w, i, x, y, dw, dh;
+	SwtText *t;
+
+	win = nextarg(&attrs, False);
+	if(sscanf(attrs, "%d %d %d %d %d", &i, &x, &y, &dw, &dh) != 5) {
+		writeout(EvError, "ERROR usage: damage <window> <index> <x> <y> <w> <h>\n");
+		return;
+	}
+	if((w = getwindowc(win)) < 0) {
+		writeout(EvError, "ERROR window/widget \"%s\" not found\n", win);
+		return;
+	}
+	if(i < 0 || i >= windows[w]->nregions || !windows[w]->regions[i]->img) {
+		writeout(EvError, "ERROR image %d not found in \"%s\"\n", i, win);
+		return;
+	}
+	t = windows[w]->regions[i];
+	if(x < 0) {
+		dw += x;
+		x = 0;
+	}
+	if(y < 0) {
+		dh += y;
+		y = 0;
+	}
+	if(dw <= 0 || dh <= 0)
+		return;
+	if(t->pending.w) {
+		dw = MAX(x + dw, t->pending.x + t->pending.w);
+		dh = MAX(y + dh, t->pending.y + t->pending.h);
+		x = MIN(x, t->pending.x);
+		y = MIN(y, t->pending.y);
+		dw -= x;
+		dh -= y;
+	}
+	t->pending.x = x;
+	t->pending.y = y;
+	t->pending.w = dw;
+	t->pending.h = dh;
+	windows[w]->uploads = True;
+}
+
+/* [<name>], new windows open on that display, connecting to it first */
+void
+procdisplay(char *attrs) {
+	char *name = attrs ? nextarg(&attrs, False) : NULL;
+	SwtDisplay *d;
+
+	if(!(d = name ? opendisplay(name) : displays[0])) {
+		writeout(EvError, "ERROR cannot open display \"%s\"\n", name);
+		return;
+	}
+	disp = d;
+	refill = True;
+	writeout(EvReply, "display %s %s\n", d->name, drw_backend(d->drw));
+}
+
+void
+procdump(char *attrs) {
+	int w;
+
+	attrs = nextarg(&attrs, True);
+	if(strcasecmp("all", attrs) == 0) {
+		dumptree();
+		return;
+	}
+	if((w = getwindowh(attrs)) < 0) {
+		writeout(EvError, "ERROR window \"%s\" not found\n", attrs);
+		return;
+	}
+	dumpwindow(windows[w], "dump");
+	for(int i=0;i<windows[w]->nregions;i++)
+		dumptext(windows[w], i, "dump");
+	fflush(outfile);
+}
+
+/* every <ms> <command> */
+void
+procevery(char *attrs) {
+	unsigned long ms;
+	char *command;
+	Timer *t;
+
+	ms = strtoul(attrs, &command, 10);
+	while(*command == ' ')
+		command++;
+	if(!ms || !*command) {
+		writeout(EvError, "ERROR usage: every <ms> <command>\n");
+		return;
+	}
+	t = addtimer(TimerCommand, ms, ms, command);
+	writeout(EvReply, "timer %lu\n", t->id);
+}
+
+void
+procformat(char *attrs) {
+	attrs = nextarg(&attrs, True);
+	if(strcasecmp("text", attrs) == 0)
+		format = FormatText;
+	else if(strcasecmp("json", attrs) == 0)
+		format = FormatJSON;
+	else
+		writeout(EvError, "ERROR unknown format: %s\n", attrs);
+}
+
+/* key <handle> <keysym>..., as if the keys were pressed in the window */
+void
+prockey(char *attrs) {
+	char *handle, *name;
+	KeySym keysym;
+	SwtWindow *focus, *target;
+	int w;
+
+	if(!(handle = nextarg(&attrs, False))) {
+		writeout(EvError, "ERROR usage: key <window> <keysym>...\n");
+		return;
+	}
+	if((w = getwindowh(handle)) < 0) {
+		writeout(EvError, "ERROR window/widget \"%s\" not found\n", handle);
+		return;
+	}
+	/* the bindings act on the focused window, lend it for the keys */
+	focus = sel > -1 ? windows[sel] : NULL;
+	target = windows[w];
+	sel = w;
+	while((name = nextarg(&attrs, False))) {
+		if((keysym = XStringToKeysym(name)) == NoSymbol) {
+			writeout(EvError, "ERROR unknown keysym: %s\n", name);
+			break;
+		}
+		handlekey(w, keysym, keysym, 0);
+		if(w >= nwindows || windows[w] != target)
+			break;
+	}
+	/* indices shift when the keys closed a window, find it again */
+	sel = -1;
+	for(int i=0;i<nwindows;i++)
+		if(windows[i] == focus)
+			sel = i;
 }
 
 void
 procremove(char *attrs) {
 }
 
+/* settext <window> <index> <text> */
+void
+procsettext(char *attrs) {
+	char *win, *index, *text;
+	int w, i;
+
+	win = nextarg(&attrs, False);
+	if(!(index = nextarg(&attrs, False))) {
+		writeout(EvError, "ERROR usage: settext <window> <index> <text>\n");
+		return;
+	}
+	if(!(text = nextarg(&attrs, True)))
+		text = "";
+
+	if((w = getwindowc(win)) < 0) {
+		writeout(EvError, "ERROR window/widget \"%s\" not found\n", win);
+		return;
+	}
+	i = atoi(index);
+	if(i < 0 || i >= windows[w]->nregions) {
+		writeout(EvError, "ERROR region %s not found in \"%s\"\n", index, win);
+		return;
+	}
+	settext(windows[w], i, text, strlen(text));
+}
+
+void
+procshow(char *attrs) {
+}
+
+/* snapshot layout, native byte order:
+ *   "SWTS" u32 version u32 nwindows
+ *   per window: u8 layout, i32 sel, str name, str title, u32 nregions
+ *   per region: i32 color, u8 flags (1 wrap, 2 clock, 4 input, 8 live
+ *               input, since version 2),
+ *               u32 blink (since version 3),
+ *               u32 image width, u32 image height (since version 4, 0 if
+ *               the region is not an image), str name,
+ *               str clock format if flagged
+ * where str is a u32 length followed by the bytes without a '\0' */
+void
+procsnapshot(char *attrs) {
+	uint32_t u32;
+	uint8_t u8;
+	int32_t i32;
+	FILE *f;
+	SwtWindow *w;
+
+	attrs = nextarg(&attrs, True);
+	if(!(f = fopen(attrs, "wb"))) {
+		writeout(EvError, "ERROR unable to open snapshot \"%s\": %s\n", attrs, strerror(errno));
+		return;
+	}
+
+	snapwrite(f, SNAPMAGIC, 4);
+	u32 = SNAPVERSION;
+	snapwrite(f, &u32, sizeof(u32));
+	u32 = nwindows;
+	snapwrite(f, &u32, sizeof(u32));
+	for(int i=0;i<nwindows;i++) {
+		w = windows[i];
+		u8 = w->layout;
+		snapwrite(f, &u8, sizeof(u8));
+		i32 = w->sel;
+		snapwrite(f, &i32, sizeof(i32));
+		snapwritestr(f, w->name);
+		snapwritestr(f, w->title);
+		u32 = w->nregions;
+		snapwrite(f, &u32, sizeof(u32));
+		for(int j=0;j<w->nregions;j++) {
+			i32 = w->regions[j]->color;
+			snapwrite(f, &i32, sizeof(i32));
+			syncinput(w, w->regions[j]);
+			u8 = w->regions[j]->wrap | (w->regions[j]->clock ? 2 : 0)
+				| (w->regions[j]->input ? 4 : 0)
+				| (w->regions[j]->input && w->regions[j]->input->live ? 8 : 0);
+			snapwrite(f, &u8, sizeof(u8));
+			u32 = w->regions[j]->blink;
+			snapwrite(f, &u32, sizeof(u32));
+			u32 = w->regions[j]->img ? w->regions[j]->img->w : 0;
+			snapwrite(f, &u32, sizeof(u32));
+			u32 = w->regions[j]->img ? w->regions[j]->img->h : 0;
+			snapwrite(f, &u32, sizeof(u32));
+			snapwritestr(f, w->regions[j]->name);
+			if(w->regions[j]->clock)
+				snapwritestr(f, w->regions[j]->clock);
+		}
+	}
+
+	if(ferror(f)) {
+		fclose(f);
+		writeout(EvError, "ERROR unable to write snapshot \"%s\"\n", attrs);
+	} else if(fclose(f) == EOF) {
+		writeout(EvError, "ERROR unable to write snapshot \"%s\"\n", attrs);
+	} else {
+		writeout(EvReply, "snapshot %s %d\n", attrs, nwindows);
+	}
+}
+
+/* subscribe <class>... sets the mask, +<class> and -<class> modify it */
+void
+procsubscribe(char *attrs) {
+	char *tok;
+	int mask = subscribed, set = 0;
+	unsigned int i;
+
+	while((tok = nextarg(&attrs, False))) {
+		if(*tok != '+' && *tok != '-' && !set++)
+			mask = 0;
+		for(i = 0; i < LENGTH(subscriptions); i++)
+			if(strcasecmp(subscriptions[i].name, tok + (*tok == '+' || *tok == '-')) == 0)
+				break;
+		if(i == LENGTH(subscriptions)) {
+			writeout(EvError, "ERROR unknown subscription: %s\n", tok);
+			return;
+		}
+		if(*tok == '-')
+			mask &= ~subscriptions[i].mask;
+		else
+			mask |= subscriptions[i].mask;
+	}
+	subscribed = mask;
+}
+
 void
-procshow(char *attrs) {
+procwatch(char *attrs, Bool watch) {
+	int w;
+
+	attrs = nextarg(&attrs, True);
+	if(strcasecmp("all", attrs) == 0) {
+		watchall = watch;
+		for(int i=0;i<nwindows;i++)
+			windows[i]->watched = watch;
+		return;
+	}
+	if((w = getwindowh(attrs)) < 0) {
+		writeout(EvError, "ERROR window \"%s\" not found\n", attrs);
+		return;
+	}
+	windows[w]->watched = watch;
 }
 
 void
@@ -551,37 +2452,279 @@ procwindow(char *attrs, Bool hlayout) {
 	char *name = NULL, *title = NULL;
 	SwtWindow *sw;
 
-	name = attrs ? attrs : "swt";
-	if(attrs && (title = strchr(attrs, ' '))) {
-		*(title++) = '\0';
-	} else {
+	if(!(name = nextarg(&attrs, False)))
+		name = "swt";
+	if(!(title = nextarg(&attrs, True)))
 		title = "swt window";
-	}
 
 	sw = createwindow(name, title, hlayout);
 
-	XMapWindow(dpy, sw->win);
-
-	XSync(dpy, False);
-	writeout("window %s %lu\n", sw->name, sw->win);
+	/* newwindow() already synced the creation */
+	if(!headless) {
+		XMapWindow(sw->disp->dpy, sw->win);
+		XFlush(sw->disp->dpy);
+	}
+	writeout(EvReply, "window %s %lu\n", sw->name->s, sw->win);
 }
 
 void
-procx11events(void) {
+procx11events(SwtDisplay *d) {
 	XEvent ev;
 
-	while(XPending(dpy)) {
-		XNextEvent(dpy, &ev);
+	while(XPending(d->dpy)) {
+		XNextEvent(d->dpy, &ev);
+		if(drw_present_event(d->dpy, &ev))
+			continue;
 		if(handler[ev.type])
 			handler[ev.type](&ev);
 	}
 }
 
+void
+queuecommand(char *command, char *attributes) {
+	struct timespec ts = { .tv_sec = 0, .tv_nsec = 1000000 };
+	size_t clen, alen;
+	uint64_t v = 1;
+	Command *c;
+
+	clen = strlen(command) + 1;
+	alen = attributes ? strlen(attributes) + 1 : 0;
+	c = emallocz(sizeof(*c) + clen + alen);
+	memcpy(c->name, command, clen);
+	if(attributes) {
+		c->attrs = c->name + clen;
+		memcpy(c->attrs, attributes, alen);
+	}
+
+	/* ring is full, make sure the X thread is draining it and back off */
+	while(!ringpush(c)) {
+		if(write(evfd, &v, sizeof(v)) == -1)
+			perror("swt failed to write to eventfd");
+		nanosleep(&ts, NULL);
+	}
+}
+
 void
 quit(const Arg *arg) {
 	running = False;
 }
 
+void
+readinput(void (*apply)(char *, char *)) {
+	/* threaded this is the reader, tcommand belongs to the X thread */
+	double t0 = timings ? cputime() : 0, c0 = threaded ? 0 : tcommand;
+	ssize_t len;
+
+	if((len = read(infd, inbuf + inlen, sizeof(inbuf) - inlen - 1)) == -1) {
+		if(errno != EAGAIN && errno != EINTR)
+			perror("swt failed to read from pipe");
+		return;
+	} else if(len == 0) {
+		resetfifo();
+		return;
+	}
+	inlen += len;
+	inbuf[inlen] = '\0';
+	frameinput(inbuf, &inlen, FIFOCLIENT, apply);
+	if(recordfile)
+		fflush(recordfile);
+
+	if(inlen == sizeof(inbuf) - 1) {
+		fprintf(stderr, "swt: command too long, discarded\n");
+		inlen = 0;
+	}
+
+	/* unthreaded the commands ran inside, they are not parsing */
+	if(timings)
+		tparse += cputime() - t0 - (threaded ? 0 : tcommand - c0);
+}
+
+/* applies the commands buf holds, keeping the incomplete tail for the
+ * next read; buf[*len] must be '\0' */
+void
+frameinput(char *buf, size_t *len, unsigned int from, void (*apply)(char *, char *)) {
+	char *s, *e, *end, quote = 0;
+	double at = recordfile ? uptime() : 0;
+
+	/* commands end with a newline or with ';' outside of quotes, only
+	 * the bytes that matter are visited */
+	end = buf + *len;
+	for(s = e = buf; (e += scanbytes(e, end - e, quote ? "\\\n\"'" : "\\\n\"';")) < end; e++) {
+		if(*e == '\\') {
+			if(++e == end)
+				break;
+		} else if(*e == '"' || *e == '\'') {
+			if(!quote)
+				quote = *e;
+			else if(quote == *e)
+				quote = 0;
+		} else {
+			*e = '\0';
+			if(recordfile)
+				record(s, e - s, from, at);
+			if(quote)
+				writeout(EvError, "ERROR unterminated quote: %s\n", s);
+			else if(!utf8valid(s, e - s))
+				writeout(EvError, "ERROR invalid UTF-8 in command\n");
+			else
+				splitcommand(s, apply);
+			quote = 0;
+			s = e + 1;
+		}
+	}
+	*len -= s - buf;
+	memmove(buf, s, *len);
+}
+
+/* appends a command to the -R recording, at is ms since startup and
+ * from the client it came from */
+void
+record(const char *s, size_t len, unsigned int from, double at) {
+	fprintf(recordfile, "%.3f %u %zu ", at, from, len);
+	fwrite(s, 1, len, recordfile);
+	fputc('\n', recordfile);
+}
+
+/* puts a closed window back into the pool, False when the pool is full */
+Bool
+recyclewindow(SwtWindow *w) {
+	int n = 0;
+	unsigned int dw, dh;
+
+	for(int i=0;i<npool;i++)
+		if(pool[i]->disp == w->disp)
+			n++;
+	if(n >= (int)windowpool)
+		return False;
+
+	cleanupregions(w);
+	w->regions = NULL;
+	w->nregions = 0;
+	w->sel = 0;
+	w->name = w->title = NULL;
+	w->watched = False;
+	w->inserting = False;
+	w->changes = 0;
+	w->uploads = False;
+	XDestroyRegion(w->damage);
+	w->damage = XCreateRegion();
+	w->dirty = True;
+	w->mapped = headless;
+	w->obscured = False;
+	w->cw = w->drw->w;
+	w->ch = w->drw->h;
+	if(!headless) {
+		dw = DisplayWidth(w->disp->dpy, w->disp->screen);
+		dh = DisplayHeight(w->disp->dpy, w->disp->screen);
+		if(w->drw->w != dw || w->drw->h != dh)
+			XResizeWindow(w->disp->dpy, w->win, dw, dh);
+		w->cw = dw;
+		w->ch = dh;
+	}
+	/* the pixmap comes back at the size above when the window is used */
+	drw_release(w->drw);
+	w->released = True;
+
+	pool = erealloc(pool, sizeof(SwtWindow *) * (npool + 1));
+	pool[npool++] = w;
+	return True;
+}
+
+/* feeds the recorded commands that are due, a whole read of the
+ * original at a time when the speed is unlimited, and times them until
+ * they are painted */
+void
+replay(void) {
+	static char *buf = NULL;
+	static size_t size = 0;
+	size_t first = nplayed, len;
+	double now = uptime() - replaystart, at = records[nplayed].at, done;
+	Record *r;
+
+	while(nplayed < nrecords && (speed > 0 ? records[nplayed].at / speed <= now
+	: records[nplayed].at == at)) {
+		r = &records[nplayed++];
+		if(r->len + 2 > size) {
+			size = r->len + 2;
+			buf = erealloc(buf, size);
+		}
+		memcpy(buf, r->cmd, r->len);
+		buf[r->len] = '\n';
+		buf[r->len + 1] = '\0';
+		len = r->len + 1;
+		frameinput(buf, &len, r->client, proccommand);
+		if(!running)
+			break;
+	}
+	if(nplayed == first)
+		return;
+	updatewindows();
+	if(watchpending)
+		watchdiff();
+
+	done = uptime() - replaystart;
+	for(size_t i=first;i<nplayed;i++)
+		records[i].latency = done - (speed > 0 ? records[i].at / speed : now);
+	replayend = done;
+	/* with a fifo the session goes on live */
+	if(nplayed == nrecords && !in)
+		running = False;
+}
+
+/* -P summary on stderr: overall, then by command name */
+void
+replayreport(void) {
+	struct {
+		const char *s;
+		size_t len, n;
+		double sum, max;
+	} *names = NULL;
+	size_t nnames = 0, j, l;
+	double *lat, sum = 0;
+	const char *name;
+
+	if(!nplayed)
+		return;
+	lat = emallocz(sizeof(double) * nplayed);
+	for(size_t i=0;i<nplayed;i++) {
+		lat[i] = records[i].latency;
+		sum += lat[i];
+	}
+	qsort(lat, nplayed, sizeof(double), cmplatency);
+	if(speed > 0)
+		fprintf(stderr, "swt: replayed %zu of %zu commands in %.3f ms at %gx, %lu frames\n",
+				nplayed, nrecords, replayend, speed, nframes - replayframes);
+	else
+		fprintf(stderr, "swt: replayed %zu of %zu commands in %.3f ms unthrottled, %lu frames\n",
+				nplayed, nrecords, replayend, nframes - replayframes);
+	fprintf(stderr, "swt: latency mean %.3f p50 %.3f p95 %.3f p99 %.3f max %.3f ms\n",
+			sum / nplayed, lat[(nplayed - 1) / 2], lat[(nplayed - 1) * 95 / 100],
+			lat[(nplayed - 1) * 99 / 100], lat[nplayed - 1]);
+	free(lat);
+
+	for(size_t i=0;i<nplayed;i++) {
+		name = records[i].cmd;
+		l = records[i].len;
+		for(; l && (*name == ' ' || *name == '\t'); name++, l--);
+		for(j = 0; j < l && name[j] != ' ' && name[j] != '\t'; j++);
+		l = j;
+		for(j = 0; j < nnames && (names[j].len != l || memcmp(names[j].s, name, l) != 0); j++);
+		if(j == nnames) {
+			names = erealloc(names, sizeof(*names) * ++nnames);
+			memset(&names[j], 0, sizeof(*names));
+			names[j].s = name;
+			names[j].len = l;
+		}
+		names[j].n++;
+		names[j].sum += records[i].latency;
+		names[j].max = MAX(names[j].max, records[i].latency);
+	}
+	for(j = 0; j < nnames; j++)
+		fprintf(stderr, "swt:   %-10.*s %8zu  mean %.3f max %.3f ms\n", (int)names[j].len,
+				names[j].s, names[j].n, names[j].sum / names[j].n, names[j].max);
+	free(names);
+}
+
 void
 resetfifo(void) {
 	closefifo();
@@ -590,6 +2733,7 @@ resetfifo(void) {
 
 void
 resize(SwtWindow *win) {
+	double t0 = timings ? cputime() : 0;
 	int w,h;
 
 	w = win->drw->w;
@@ -611,27 +2755,180 @@ resize(SwtWindow *win) {
 		win->regions[i]->r.w = w - (bordersize*2);
 		win->regions[i]->r.h = h - (bordersize*2);
 	}
+
+	if(timings) {
+		pthread_mutex_lock(&statlock);
+		tlayout += cputime() - t0;
+		nlayout++;
+		pthread_mutex_unlock(&statlock);
+	}
+}
+
+Command *
+ringpop(void) {
+	unsigned int h = ringhead;
+	Command *c;
+
+	if(h == __atomic_load_n(&ringtail, __ATOMIC_ACQUIRE))
+		return NULL;
+	c = ring[h & (RINGSIZE - 1)];
+	__atomic_store_n(&ringhead, h + 1, __ATOMIC_RELEASE);
+	return c;
+}
+
+Bool
+ringpush(Command *c) {
+	unsigned int t = ringtail;
+
+	if(t - __atomic_load_n(&ringhead, __ATOMIC_ACQUIRE) == RINGSIZE)
+		return False;
+	ring[t & (RINGSIZE - 1)] = c;
+	__atomic_store_n(&ringtail, t + 1, __ATOMIC_RELEASE);
+	return True;
+}
+
+void
+restore(const char *path) {
+	struct stat st;
+	const char *map, *p, *end, *name, *title, *text;
+	char *cname, *ctitle;
+	const char *clock;
+	uint32_t version, nwins, nregs, namelen, titlelen, len, clocklen, blink = 0, iw = 0, ih = 0;
+	uint8_t layout, flags = 0;
+	int32_t wsel, color;
+	SwtWindow *sw;
+	SwtText *t;
+	Timer *tm;
+	int fd, first = nwindows;
+
+	if((fd = open(path, O_RDONLY)) == -1 || fstat(fd, &st) == -1) {
+		perror("swt unable to open snapshot");
+		exit(EXIT_FAILURE);
+	}
+	if(st.st_size < 12
+	|| (map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED)
+		die("swt invalid snapshot: %s\n", path);
+	close(fd);
+	p = map;
+	end = map + st.st_size;
+
+	if(memcmp(p, SNAPMAGIC, 4) != 0)
+		die("swt invalid snapshot: %s\n", path);
+	p += 4;
+	if(!snapread(&p, end, &version, sizeof(version)) || version < 1 || version > SNAPVERSION)
+		die("swt unsupported snapshot version: %s\n", path);
+	if(!snapread(&p, end, &nwins, sizeof(nwins)))
+		goto truncated;
+
+	for(uint32_t i=0;i<nwins;i++) {
+		if(!snapread(&p, end, &layout, sizeof(layout))
+		|| !snapread(&p, end, &wsel, sizeof(wsel))
+		|| !snapreadstr(&p, end, &name, &namelen)
+		|| !snapreadstr(&p, end, &title, &titlelen)
+		|| !snapread(&p, end, &nregs, sizeof(nregs)))
+			goto truncated;
+
+		cname = emallocz(namelen + 1);
+		memcpy(cname, name, namelen);
+		ctitle = emallocz(titlelen + 1);
+		memcpy(ctitle, title, titlelen);
+		sw = createwindow(cname, ctitle, layout == HorizLayout);
+		free(cname);
+		free(ctitle);
+
+		sw->regions = emallocz(sizeof(SwtText *) * nregs);
+		for(uint32_t j=0;j<nregs;j++) {
+			if(!snapread(&p, end, &color, sizeof(color))
+			|| (version > 1 && !snapread(&p, end, &flags, sizeof(flags)))
+			|| (version > 2 && !snapread(&p, end, &blink, sizeof(blink)))
+			|| (version > 3 && (!snapread(&p, end, &iw, sizeof(iw)) || !snapread(&p, end, &ih, sizeof(ih))))
+			|| !snapreadstr(&p, end, &text, &len)
+			|| (flags & 2 && !snapreadstr(&p, end, &clock, &clocklen)))
+				goto truncated;
+			t = arenaalloc(&sw->arena, sizeof(*t));
+			t->name = intern(&sw->arena, text, len);
+			t->color = color;
+			t->wrap = flags & 1;
+			t->blink = blink;
+			if(flags & 4) {
+				t->input = emallocz(sizeof(Input));
+				setinput(t->input, text, len);
+				t->input->live = (flags & 8) != 0;
+			}
+			/* an image that is gone leaves its name as text */
+			if(iw && ih)
+				openimage(sw, t, iw, ih);
+			sw->regions[sw->nregions++] = t;
+			if(flags & 2) {
+				t->clock = intern(&sw->arena, clock, clocklen);
+				tm = addtimer(TimerClock, 1000, 0, NULL);
+				tm->win = sw;
+				tm->region = j;
+			}
+			if(blink) {
+				tm = addtimer(TimerBlink, blink, blink, NULL);
+				tm->win = sw;
+				tm->region = j;
+			}
+		}
+		sw->sel = wsel;
+		/* one layout now, the first expose paints it once */
+		resize(sw);
+		if(!headless)
+			XMapWindow(sw->disp->dpy, sw->win);
+	}
+	munmap((void *)map, st.st_size);
+
+	if(!headless)
+		XSync(disp->dpy, False);
+	for(int i=first;i<nwindows;i++)
+		writeout(EvReply, "window %s %lu\n", windows[i]->name->s, windows[i]->win);
+	return;
+
+truncated:
+	die("swt truncated snapshot: %s\n", path);
 }
 
 void
 run(void) {
 	time_t last_response;
+	unsigned long commands = 0;
 
 	last_response = time(NULL);
-	x11fd = XConnectionNumber(dpy);
 
 	for(;;) {
-		int i, nfds = 0;
+		int i, fd, nfds = 0;
+		long ms;
 		fd_set rd;
 		struct timeval tv = { .tv_sec = PING_TIMEOUT / 5, .tv_usec = 0 };
 
+		/* poll while there is something left to warm up */
+		if(warmed >= 0 || refill)
+			tv.tv_sec = 0;
+		else if((ms = nexttimer()) >= 0 && ms < tv.tv_sec * 1000) {
+			tv.tv_sec = ms / 1000;
+			tv.tv_usec = ms % 1000 * 1000;
+		}
+		if((ms = nextrecord()) >= 0 && ms < tv.tv_sec * 1000 + tv.tv_usec / 1000) {
+			tv.tv_sec = ms / 1000;
+			tv.tv_usec = ms % 1000 * 1000;
+		}
+
 		if (!running) break;
 
 		FD_ZERO(&rd);
-		FD_SET(infd, &rd);
-		FD_SET(x11fd, &rd);
-		nfds = MAX(nfds, infd);
-		nfds = MAX(nfds, x11fd);
+		/* a replay may run without the fifo */
+		if(in) {
+			FD_SET(threaded ? evfd : infd, &rd);
+			nfds = MAX(nfds, threaded ? evfd : infd);
+		}
+		for(int j=0;j<ndisplays;j++) {
+			if(!displays[j]->dpy)
+				continue;
+			fd = XConnectionNumber(displays[j]->dpy);
+			FD_SET(fd, &rd);
+			nfds = MAX(nfds, fd);
+		}
 
 		i = select(nfds + 1, &rd, NULL, NULL, &tv);
 
@@ -640,46 +2937,368 @@ run(void) {
 		if(i == -1) {
 			perror("swt error on select()");
 			exit(EXIT_FAILURE);
-		} else if(i == 0) {
+		}
+
+		if(ntimers && runtimers()) {
+			updatewindows();
+			if(watchpending)
+				watchdiff();
+		}
+		if(nplayed < nrecords)
+			replay();
+
+		if(i == 0) {
+			if(warmed >= 0) {
+				warmup();
+				continue;
+			}
+			if(refill) {
+				fillpool();
+				continue;
+			}
 			if(time(NULL) - last_response >= PING_TIMEOUT) {
-				writeout("NOOP\n");
+				writeout(EvHeartbeat, "NOOP\n");
 			}
 			continue;
 		} else {
-			if(FD_ISSET(infd, &rd)) {
+			if(threaded && FD_ISSET(evfd, &rd)) {
+				last_response = time(NULL);
+				procqueue();
+				if(!commands++)
+					phase("first input");
+			} else if(!threaded && in && FD_ISSET(infd, &rd)) {
 				last_response = time(NULL);
 				procinput();
+				if(!commands++)
+					phase("first input");
 			}
-			if(FD_ISSET(x11fd, &rd)) {
-				last_response = time(NULL);
-				procx11events();
+			/* events another display's traffic left queued count too */
+			for(int j=0;j<ndisplays;j++) {
+				if(!displays[j]->dpy)
+					continue;
+				if(FD_ISSET(XConnectionNumber(displays[j]->dpy), &rd)
+						|| XQLength(displays[j]->dpy)) {
+					last_response = time(NULL);
+					procx11events(displays[j]);
+				}
+			}
+			/* paint what the input and the events changed */
+			updatewindows();
+			if(watchpending)
+				watchdiff();
+		}
+	}
+
+	writeout(EvReply, "done\n");
+}
+
+/* runs every tick up to now, the timers due are fired together so
+ * that updatewindows() paints them in one frame */
+int
+runtimers(void) {
+	uint64_t now = ticks();
+	struct timespec wall;
+	Timer *t, *next, **tail = &firing;
+	int n = 0, idx;
+
+	for(; wheeltick <= now; wheeltick++) {
+		idx = wheeltick & (WHEELSIZE - 1);
+		/* a finer level wrapped, spread the next slot of the coarser one */
+		for(int l=1;l<WHEELLEVELS && !((wheeltick >> (WHEELBITS * (l - 1))) & (WHEELSIZE - 1));l++) {
+			t = wheel[l][(wheeltick >> (WHEELBITS * l)) & (WHEELSIZE - 1)];
+			wheel[l][(wheeltick >> (WHEELBITS * l)) & (WHEELSIZE - 1)] = NULL;
+			for(; t; t = next) {
+				next = t->next;
+				scheduletimer(t);
 			}
 		}
+		*tail = wheel[0][idx];
+		wheel[0][idx] = NULL;
+		while(*tail)
+			tail = &(*tail)->next;
 	}
 
-	writeout("done\n");
+	while((current = firing)) {
+		firing = current->next;
+		firetimer(current);
+		n++;
+		if(current->dead || !current->period) {
+			free(current);
+			ntimers--;
+			continue;
+		}
+		if(current->type == TimerClock) {
+			/* next wall clock second */
+			clock_gettime(CLOCK_REALTIME, &wall);
+			current->expires = now + (1000 - wall.tv_nsec / 1000000) / TICK + 1;
+		} else {
+			/* skip the periods missed while blocked */
+			current->expires += current->period;
+			if(current->expires <= now)
+				current->expires = now + current->period - (now - current->expires) % current->period;
+		}
+		scheduletimer(current);
+	}
+	return n;
+}
+
+/* files t in the slot of the finest level whose span covers its expiry */
+void
+scheduletimer(Timer *t) {
+	uint64_t e = MAX(t->expires, wheeltick), d = e - wheeltick;
+	int l, slot;
+
+	if(d >> (WHEELBITS * WHEELLEVELS))
+		e = wheeltick + (1ULL << (WHEELBITS * WHEELLEVELS)) - 1;
+	d = e - wheeltick;
+	for(l = 0; l < WHEELLEVELS - 1 && d >> (WHEELBITS * (l + 1)); l++);
+	slot = (e >> (WHEELBITS * l)) & (WHEELSIZE - 1);
+	t->next = wheel[l][slot];
+	wheel[l][slot] = t;
+}
+
+/* scrolls input region t so that its cursor shows, returns whether it did */
+Bool
+scrollinput(SwtWindow *w, SwtText *t) {
+	Input *in = t->input;
+	Fnt *f = w->drw->font;
+	unsigned int old = in->scroll, avail = wrapwidth(w, t), x = 0, p, q, n;
+	char c[4];
+
+	if(in->cursor <= in->scroll) {
+		in->scroll = in->cursor;
+		return in->scroll != old;
+	}
+	for(p = in->scroll; p < in->cursor && x < avail; p += n) {
+		n = inputchar(in, p, c);
+		x += drw_font_advance(f, c, n);
+	}
+	if(x < avail)
+		return False;
+	/* show as much as fits before the cursor */
+	for(p = in->cursor, x = 0; p > 0; p = q) {
+		q = prevchar(in, p);
+		n = inputchar(in, q, c);
+		x += drw_font_advance(f, c, n);
+		if(x >= avail)
+			break;
+	}
+	in->scroll = p;
+	return in->scroll != old;
+}
+
+/* moves the cursor of input region i, repainting from where it was */
+void
+setcursor(SwtWindow *w, int i, unsigned int pos) {
+	Input *in = w->regions[i]->input;
+	unsigned int from = MIN(pos, in->cursor);
+
+	if(pos == in->cursor)
+		return;
+	in->cursor = pos;
+	damagespan(w, i, from);
+}
+
+void
+setinput(Input *in, const char *s, unsigned int len) {
+	if(!in->buf || len > in->size) {
+		in->size = MAX(len * 2, 64);
+		in->buf = erealloc(in->buf, in->size);
+	}
+	memcpy(in->buf, s, len);
+	in->gap = len;
+	in->end = in->size;
+	in->cursor = len;
+	in->scroll = 0;
+	in->stale = False;
+}
+
+void
+settext(SwtWindow *w, int i, const char *text, unsigned int len) {
+	SwtText *t = w->regions[i];
+	Str *old;
+	unsigned int from;
+
+	syncinput(w, t);
+	old = t->name;
+	if(old->len == len && memcmp(old->s, text, len) == 0)
+		return;
+	for(from = 0; from < len && from < old->len && old->s[from] == text[from]; from++);
+	t->name = intern(&w->arena, text, len);
+	/* a clock keeps its format */
+	if(old != t->clock)
+		w->arena.dead += sizeof(Str) + old->len + 1;
+	if(t->input)
+		setinput(t->input, text, len);
+	if(t->wrap && t->wrapw)
+		wraptext(w, t, t->wrapw, from);
+	if(w->watched) {
+		t->changes |= ChgChanged;
+		watchpending = True;
+	}
+	/* replaced strings stay in the arena until it is mostly garbage */
+	if(w->arena.dead * 2 > w->arena.used)
+		compactarena(w);
+	damageregion(w, i);
 }
 
 void
 setup(void) {
-	createfifo();
+	if(in)
+		createfifo();
 	createout();
+	if(recordpath && !(recordfile = fopen(recordpath, "w"))) {
+		perror("swt unable to open recording");
+		exit(EXIT_FAILURE);
+	}
+	phase("fifo");
+
+	if(threaded)
+		startreader();
+	phase("setup");
+}
+
+/* applies the latest geometry and brings back a released pixmap, either
+ * needs a full paint */
+void
+sizewindow(SwtWindow *w) {
+	if(w->cw != w->drw->w || w->ch != w->drw->h) {
+		drw_resize(w->drw, w->cw, w->ch);
+		resize(w);
+	} else if(w->released) {
+		drw_resize(w->drw, w->drw->w, w->drw->h);
+	} else {
+		return;
+	}
+	w->released = False;
+	w->dirty = True;
+	/* a hidden window captured counts against the budget again */
+	if(!VISIBLE(w))
+		trim = True;
+}
+
+Bool
+snapread(const char **p, const char *end, void *v, size_t len) {
+	if((size_t)(end - *p) < len)
+		return False;
+	memcpy(v, *p, len);
+	*p += len;
+	return True;
+}
+
+/* points s into the mapping, the string is not '\0' terminated */
+Bool
+snapreadstr(const char **p, const char *end, const char **s, uint32_t *len) {
+	if(!snapread(p, end, len, sizeof(*len)) || (size_t)(end - *p) < *len)
+		return False;
+	*s = *p;
+	*p += *len;
+	return True;
+}
+
+void
+snapwrite(FILE *f, const void *v, size_t len) {
+	fwrite(v, 1, len, f);
+}
+
+void
+snapwritestr(FILE *f, const Str *s) {
+	uint32_t len = s->len;
+
+	snapwrite(f, &len, sizeof(len));
+	snapwrite(f, s->s, len);
+}
+
+/* the attributes are left quoted, handlers take them apart with nextarg() */
+void
+splitcommand(char *s, void (*apply)(char *, char *)) {
+	char *command;
+
+	if(!(command = nextarg(&s, False)))
+		return;
+	while(*s == ' ' || *s == '\t')
+		s++;
+	apply(command, *s ? s : NULL);
+}
+
+void
+startreader(void) {
+	if((evfd = eventfd(0, EFD_NONBLOCK)) == -1
+	|| (stopfd = eventfd(0, 0)) == -1)
+		die("swt cannot create eventfd\n");
+	if(pthread_create(&reader, NULL, inputthread, NULL) != 0)
+		die("swt cannot create input thread\n");
+}
+
+void
+stoppainters(void) {
+	pthread_mutex_lock(&paintlock);
+	for(int i=0;i<ndisplays;i++)
+		displays[i]->quit = True;
+	pthread_cond_broadcast(&paintstart);
+	pthread_mutex_unlock(&paintlock);
+	for(int i=0;i<ndisplays;i++)
+		if(displays[i]->started)
+			pthread_join(displays[i]->painter, NULL);
+}
+
+void
+stopreader(void) {
+	Command *c;
+	uint64_t v = 1;
+
+	if(write(stopfd, &v, sizeof(v)) == -1)
+		perror("swt failed to write to eventfd");
+	pthread_join(reader, NULL);
+	while((c = ringpop()))
+		free(c);
+	close(stopfd);
+	close(evfd);
+}
 
-	screen = DefaultScreen(dpy);
-	root = RootWindow(dpy, screen);
+/* FNV-1a */
+unsigned int
+strhash(const char *s, size_t len) {
+	unsigned int h = 2166136261u;
 
-	Drw *drw = drw_create(dpy, screen, root, DisplayWidth(dpy, screen), DisplayHeight(dpy, screen));
-	cursor[CurNormal] = drw_cur_create(drw, XC_left_ptr);
-	cursor[CurResize] = drw_cur_create(drw, XC_sizing);
-	cursor[CurMove]   = drw_cur_create(drw, XC_fleur);
+	for(size_t i = 0; i < len; i++)
+		h = (h ^ (unsigned char)s[i]) * 16777619u;
+	return h;
+}
+
+/* brings the name of input region t up to date for those reading it, the
+ * caller compacts the arena once it is done with t */
+void
+syncinput(SwtWindow *w, SwtText *t) {
+	Input *in = t->input;
+
+	if(!in || !in->stale)
+		return;
+	gapmove(in, GAPLEN(in));
+	w->arena.dead += sizeof(Str) + t->name->len + 1;
+	t->name = intern(&w->arena, in->buf, in->gap);
+	in->stale = False;
+}
+
+void
+tickclock(SwtWindow *w, int i) {
+	char buf[256];
+	struct tm tm;
+	time_t now = time(NULL);
+	size_t len;
+
+	localtime_r(&now, &tm);
+	len = strftime(buf, sizeof(buf), w->regions[i]->clock->s, &tm);
+	settext(w, i, buf, len);
+}
+
+/* TICK ms steps since startup */
+uint64_t
+ticks(void) {
+	struct timespec now;
 
-	scheme[SchemeNorm].fg     = drw_clr_create(drw, normfgcolor);
-	scheme[SchemeNorm].bg     = drw_clr_create(drw, normbgcolor);
-	scheme[SchemeNorm].border = drw_clr_create(drw, normbordercolor);
-	scheme[SchemeSel].fg      = drw_clr_create(drw, selfgcolor);
-	scheme[SchemeSel].bg      = drw_clr_create(drw, selbgcolor);
-	scheme[SchemeSel].border  = drw_clr_create(drw, selbordercolor);
-	drw_free(drw);
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return ((uint64_t)(now.tv_sec - tstart.tv_sec) * 1000 + (now.tv_nsec - tstart.tv_nsec) / 1000000) / TICK;
 }
 
 void
@@ -694,18 +3313,229 @@ toggleselect(const Arg *arg) {
 		cur = windows[sel]->nregions - 1;
 
 	windows[sel]->sel = cur;
+	writeout(EvSelect, "select %s %d\n", windows[sel]->name->s, cur);
+	if(windows[sel]->watched) {
+		windows[sel]->changes |= ChgChanged;
+		watchpending = True;
+	}
 	draw(windows[sel]);
 }
 
+/* releases the pixmaps of hidden windows, the longest hidden first, until
+ * the remaining ones fit in hiddenbudget */
+void
+trimhidden(void) {
+	SwtWindow *w, *oldest;
+	size_t total;
+
+	trim = False;
+	for(;;) {
+		total = 0;
+		oldest = NULL;
+		for(int i=0;i<nwindows;i++) {
+			w = windows[i];
+			if(VISIBLE(w) || w->released)
+				continue;
+			total += drw_bytes(w->drw);
+			if(!oldest || w->hidden < oldest->hidden)
+				oldest = w;
+		}
+		if(!oldest || total <= hiddenbudget)
+			return;
+		drw_release(oldest->drw);
+		oldest->released = True;
+		oldest->dirty = True;
+	}
+}
+
+void
+unmapnotify(const XEvent *e) {
+	const XUnmapEvent *ev = &e->xunmap;
+	int w;
+
+	if((w = getwindow(ev->display, ev->window)) < 0)
+		return;
+	hidewindow(windows[w]);
+	windows[w]->mapped = False;
+}
+
+/* paints the windows of every display, each on its own painter thread
+ * once there are several, and waits for all of them */
+void
+updatewindows(void) {
+	if(trim)
+		trimhidden();
+	if(ndisplays == 1) {
+		nframes += paintdisplay(displays[0]);
+		return;
+	}
+	pthread_mutex_lock(&paintlock);
+	for(int i=0;i<ndisplays;i++) {
+		if(!displays[i]->started) {
+			if(pthread_create(&displays[i]->painter, NULL, paintthread, displays[i]) != 0)
+				die("swt cannot create painter thread\n");
+			displays[i]->started = True;
+		}
+		displays[i]->painting = True;
+	}
+	npainting = ndisplays;
+	pthread_cond_broadcast(&paintstart);
+	while(npainting)
+		pthread_cond_wait(&paintdone, &paintlock);
+	pthread_mutex_unlock(&paintlock);
+}
+
+/* copies the pending image areas into the pixmap and damages them */
+void
+uploadimages(SwtWindow *w) {
+	SwtText *t;
+	XRectangle r;
+
+	w->uploads = False;
+	for(int i=0;i<w->nregions;i++) {
+		t = w->regions[i];
+		if(!t->pending.w || !checkimage(w, t))
+			continue;
+		/* a full paint uploads everything */
+		if(!w->dirty && t->pending.x < t->r.w && t->pending.y < t->r.h) {
+			t->pending.w = MIN(t->pending.w, t->r.w - t->pending.x);
+			t->pending.h = MIN(t->pending.h, t->r.h - t->pending.y);
+			drw_img(w->drw, t->r.x, t->r.y, t->img, t->pending.x, t->pending.y, t->pending.w, t->pending.h);
+			r.x = t->r.x + t->pending.x;
+			r.y = t->r.y + t->pending.y;
+			r.width = t->pending.w;
+			r.height = t->pending.h;
+			XUnionRectWithRegion(&r, w->damage, w->damage);
+		}
+		t->pending.w = 0;
+	}
+}
+
+/* monotonic ms since startup */
+double
+uptime(void) {
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - tstart.tv_sec) * 1e3 + (now.tv_nsec - tstart.tv_nsec) / 1e6;
+}
+
 void
 usage(void) {
-	die("usage: %s [-v] -i <infifo> -o <outfile>\n", basename(argv0));
+	die("usage: %s [-HtTv] [-r <snapshot>] [-R <recording>] [-P <recording> [-S <speed>]]\n"
+			"       [-i <infifo>] -o <outfile>\n", basename(argv0));
+}
+
+/* creates one deferred resource per idle loop iteration */
+void
+warmup(void) {
+	switch(warmed) {
+	case 0: getscheme(disp, SchemeNorm); phase("warm norm scheme"); break;
+	case 1: getfont(disp);               phase("warm font");        break;
+	case 2: getscheme(disp, SchemeSel);  phase("warm sel scheme");  break;
+	case 3: getcursor(disp, CurNormal);  phase("warm cursor");      break;
+	default: warmed = -1; return;
+	}
+	warmed++;
+}
+
+void
+visibilitynotify(const XEvent *e) {
+	const XVisibilityEvent *ev = &e->xvisibility;
+	int w;
+
+	if((w = getwindow(ev->display, ev->window)) < 0)
+		return;
+	if(ev->state == VisibilityFullyObscured)
+		hidewindow(windows[w]);
+	windows[w]->obscured = ev->state == VisibilityFullyObscured;
+}
+
+/* reports what changed since the last frame to the watchers */
+void
+watchdiff(void) {
+	SwtWindow *w;
+
+	for(int i=0;i<nwindows;i++) {
+		w = windows[i];
+		if(!w->watched)
+			continue;
+		if(w->changes) {
+			dumpwindow(w, (w->changes & ChgAdded) ? "added" : "changed");
+			w->changes = 0;
+		}
+		for(int j=0;j<w->nregions;j++) {
+			if(!w->regions[j]->changes)
+				continue;
+			dumptext(w, j, (w->regions[j]->changes & ChgAdded) ? "added" : "changed");
+			w->regions[j]->changes = 0;
+		}
+	}
+	fflush(outfile);
+	watchpending = False;
+}
+
+/* breaks t into lines of at most width pixels, keeping the lines before
+ * the one holding byte from: an edit there can only move words into the
+ * previous line, so breaking restarts one line earlier */
+void
+wraptext(SwtWindow *win, SwtText *t, unsigned int width, unsigned int from) {
+	const char *s = t->name->s;
+	unsigned int len = t->name->len, l = 0, start = 0, brk, w, cw, i, n;
+	Fnt *f = win->drw->font;
+
+	if(t->nlines && t->wrapw == width) {
+		for(; l + 1 < t->nlines && t->lines[l + 1] <= from; l++);
+		if(l > 0)
+			l--;
+		start = t->lines[l];
+	}
+	t->nlines = l;
+	t->wrapw = width;
+
+	for(;;) {
+		if(t->nlines == t->maxlines) {
+			t->maxlines = t->maxlines ? t->maxlines * 2 : 8;
+			t->lines = erealloc(t->lines, sizeof(unsigned int) * t->maxlines);
+		}
+		t->lines[t->nlines++] = start;
+
+		w = 0;
+		brk = start;
+		for(i = start; i < len && s[i] != '\n'; i += n) {
+			for(n = 1; i + n < len && (s[i + n] & 0xc0) == 0x80; n++);
+			cw = drw_font_advance(f, &s[i], n);
+			if(w + cw > width && i > start)
+				break;
+			w += cw;
+			if(s[i] == ' ')
+				brk = i + 1;
+		}
+		if(i >= len)
+			break;
+		if(s[i] == '\n')
+			start = i + 1;
+		else
+			start = brk > start ? brk : i; /* words wider than a line are cut */
+	}
+}
+
+/* drw_text() pads the text by half the line height on the left */
+unsigned int
+wrapwidth(SwtWindow *w, SwtText *t) {
+	unsigned int lh = w->drw->font->h;
+
+	return t->r.w > (int)lh ? t->r.w - lh : 1;
 }
 
 void
-writeout(const char *msg, ...) {
+writeout(int ev, const char *msg, ...) {
 	va_list ap;
 
+	/* nobody listens, don't even format it */
+	if(!(subscribed & ev))
+		return;
+
 	va_start(ap, msg);
 	vfprintf(outfile, msg, ap);
 	va_end(ap);
@@ -713,15 +3543,52 @@ writeout(const char *msg, ...) {
 	fflush(outfile);
 }
 
+/* like writeout() for output built in pieces, the caller flushes */
+void
+writepart(int ev, const char *msg, ...) {
+	va_list ap;
+
+	if(!(subscribed & ev))
+		return;
+
+	va_start(ap, msg);
+	vfprintf(outfile, msg, ap);
+	va_end(ap);
+}
+
 int
 main(int argc, char *argv[]) {
+	clock_gettime(CLOCK_MONOTONIC, &tstart);
+	tlast = tstart;
+
 	ARGBEGIN {
+	case 'H':
+		headless = True;
+		break;
 	case 'i':
 		in = EARGF(usage());
 		break;
 	case 'o':
 		out = EARGF(usage());
 		break;
+	case 'P':
+		replaypath = EARGF(usage());
+		break;
+	case 'r':
+		snapfile = EARGF(usage());
+		break;
+	case 'R':
+		recordpath = EARGF(usage());
+		break;
+	case 'S':
+		speed = atof(EARGF(usage()));
+		break;
+	case 't':
+		threaded = True;
+		break;
+	case 'T':
+		timings = True;
+		break;
 	case 'v':
 		die("swt-"VERSION", © 2013 swt engineers"
 				", see LICENSE for details.\n");
@@ -729,16 +3596,27 @@ main(int argc, char *argv[]) {
 		usage();
 	} ARGEND;
 
-	if(!in || !out) usage();
+	if((!in && !replaypath) || !out) usage();
+	if(!in)
+		threaded = False; /* nothing to read */
+	/* each display gets a painter thread once there are several */
+	if(!headless && !XInitThreads())
+		die("swt cannot initialize Xlib threads\n");
 
-	if(!(dpy = XOpenDisplay(NULL)))
+	if(!(disp = opendisplay(NULL)))
 		die("swt cannot open display\n");
+	phase("open display");
 
 	setup();
+	if(snapfile) {
+		restore(snapfile);
+		phase("restore");
+	}
+	if(replaypath)
+		loadreplay(replaypath);
 	run();
 	cleanup();
 
-	XCloseDisplay(dpy);
 	return EXIT_SUCCESS;
 }
 
@@ -0,0 +1,21 @@
+#!/bin/sh
+#renders without an X server and captures the window, needs no xdotool
+
+BIN="../swt"
+IN="./in"
+OUT="./out"
+
+exec $BIN -H -T -i $IN -o $OUT &
+
+SWT_PID=$!
+
+cat /dev/null > $OUT
+
+echo "window testing This is a new window" > $IN
+echo "add testing text lorem ipsum" > $IN
+echo "add testing text color=#ff0000 dolor sit amet" > $IN
+echo "capture testing ./testing.ppm" > $IN
+sleep 1
+grep "capture testing" $OUT
+echo "quit" > $IN
+wait $SWT_PID
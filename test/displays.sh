@@ -0,0 +1,52 @@
+#!/bin/sh
+#serves two Xvfb servers from one swt, each display paints on its own thread
+
+BIN="../swt"
+IN="./in"
+OUT="./out"
+DPY1=":97"
+DPY2=":98"
+
+Xvfb $DPY1 -nolisten tcp &
+XVFB1_PID=$!
+Xvfb $DPY2 -nolisten tcp &
+XVFB2_PID=$!
+sleep 1
+
+DISPLAY=$DPY1 $BIN -i $IN -o $OUT &
+
+SWT_PID=$!
+
+cat /dev/null > $OUT
+
+echo "window first This is on the first display" > $IN
+echo "add first text lorem ipsum" > $IN
+echo "display $DPY2" > $IN
+echo "window second This is on the second display" > $IN
+echo "add second text dolor sit amet" > $IN
+for i in 1 2 3 4 5 6 7 8; do
+	echo "settext first 0 frame $i" > $IN
+	echo "settext second 0 frame $i" > $IN
+	sleep 0.1
+done
+echo "capture first ./first.ppm" > $IN
+echo "capture second ./second.ppm" > $IN
+sleep 1
+
+FIRST=`grep "window first" $OUT | awk '{print $3}'`
+SECOND=`grep "window second" $OUT | awk '{print $3}'`
+if xwininfo -display $DPY1 -id $FIRST >/dev/null 2>&1 \
+&& xwininfo -display $DPY2 -id $SECOND >/dev/null 2>&1 \
+&& grep -q "capture first" $OUT && grep -q "capture second" $OUT; then
+	echo "PASS"
+	STATUS=0
+else
+	echo "FAIL"
+	cat $OUT
+	STATUS=1
+fi
+
+echo "quit" > $IN
+wait $SWT_PID
+kill $XVFB1_PID $XVFB2_PID
+exit $STATUS
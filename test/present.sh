@@ -0,0 +1,52 @@
+#!/bin/sh
+#presents through a private Xvfb, swt has to be built with Present:
+#  make clean && make PRESENTFLAGS=-DPRESENT PRESENTLIBS="-lXpresent -lXfixes"
+
+BIN="../swt"
+IN="./in"
+OUT="./out"
+DPY=":99"
+
+Xvfb $DPY -nolisten tcp &
+
+XVFB_PID=$!
+
+sleep 1
+if ! xdpyinfo -display $DPY | grep -q Present; then
+	echo "FAIL Xvfb on $DPY has no Present extension"
+	kill $XVFB_PID
+	exit 1
+fi
+
+DISPLAY=$DPY $BIN -i $IN -o $OUT &
+
+SWT_PID=$!
+
+cat /dev/null > $OUT
+
+echo "display" > $IN
+echo "window testing This is a new window" > $IN
+echo "add testing text lorem ipsum" > $IN
+# more frames than back buffers, each waits for the server to idle one
+for i in 1 2 3 4 5 6 7 8; do
+	echo "settext testing 0 frame $i" > $IN
+	sleep 0.1
+done
+echo "capture testing ./present.ppm" > $IN
+sleep 1
+
+# a build without -DPRESENT reports copy
+if grep -q "^display .* present$" $OUT && grep -q "capture testing" $OUT \
+&& kill -0 $SWT_PID 2>/dev/null; then
+	echo "PASS"
+	STATUS=0
+else
+	echo "FAIL"
+	cat $OUT
+	STATUS=1
+fi
+
+echo "quit" > $IN
+wait $SWT_PID
+kill $XVFB_PID
+exit $STATUS
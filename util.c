@@ -2,6 +2,11 @@
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#if defined(__GNUC__) && (defined(__x86_64__) || (defined(__i386__) && defined(__SSE2__)))
+#include <immintrin.h>
+#define VECSCAN
+#endif
 
 #include "util.h"
 
@@ -15,3 +20,143 @@ die(const char *errstr, ...) {
 	exit(EXIT_FAILURE);
 }
 
+static size_t
+scan_scalar(const char *s, size_t i, size_t len, const char *set) {
+	for(; i < len; i++)
+		if(s[i] && strchr(set, s[i]))
+			return i;
+	return len;
+}
+
+static size_t
+ascii_scalar(const char *s, size_t i, size_t len) {
+	for(; i < len && !(s[i] & 0x80); i++);
+	return i;
+}
+
+#ifdef VECSCAN
+static int
+hasavx2(void) {
+	static int avx2 = -1;
+
+	if(avx2 < 0)
+		avx2 = __builtin_cpu_supports("avx2") ? 1 : 0;
+	return avx2;
+}
+
+static size_t
+scan_sse2(const char *s, size_t len, const char *set, size_t nset) {
+	__m128i v[SCANSET], c, m;
+	size_t i, k;
+	int mask;
+
+	for(k = 0; k < nset; k++)
+		v[k] = _mm_set1_epi8(set[k]);
+	for(i = 0; i + 16 <= len; i += 16) {
+		c = _mm_loadu_si128((const __m128i *)(s + i));
+		m = _mm_cmpeq_epi8(c, v[0]);
+		for(k = 1; k < nset; k++)
+			m = _mm_or_si128(m, _mm_cmpeq_epi8(c, v[k]));
+		if((mask = _mm_movemask_epi8(m)))
+			return i + __builtin_ctz(mask);
+	}
+	return scan_scalar(s, i, len, set);
+}
+
+__attribute__((target("avx2")))
+static size_t
+scan_avx2(const char *s, size_t len, const char *set, size_t nset) {
+	__m256i v[SCANSET], c, m;
+	size_t i, k;
+	unsigned int mask;
+
+	for(k = 0; k < nset; k++)
+		v[k] = _mm256_set1_epi8(set[k]);
+	for(i = 0; i + 32 <= len; i += 32) {
+		c = _mm256_loadu_si256((const __m256i *)(s + i));
+		m = _mm256_cmpeq_epi8(c, v[0]);
+		for(k = 1; k < nset; k++)
+			m = _mm256_or_si256(m, _mm256_cmpeq_epi8(c, v[k]));
+		if((mask = _mm256_movemask_epi8(m)))
+			return i + __builtin_ctz(mask);
+	}
+	return scan_sse2(s + i, len - i, set, nset) + i;
+}
+
+static size_t
+ascii_sse2(const char *s, size_t i, size_t len) {
+	int mask;
+
+	for(; i + 16 <= len; i += 16)
+		if((mask = _mm_movemask_epi8(_mm_loadu_si128((const __m128i *)(s + i)))))
+			return i + __builtin_ctz(mask);
+	return ascii_scalar(s, i, len);
+}
+
+__attribute__((target("avx2")))
+static size_t
+ascii_avx2(const char *s, size_t i, size_t len) {
+	unsigned int mask;
+
+	for(; i + 32 <= len; i += 32)
+		if((mask = _mm256_movemask_epi8(_mm256_loadu_si256((const __m256i *)(s + i)))))
+			return i + __builtin_ctz(mask);
+	return ascii_sse2(s, i, len);
+}
+#endif
+
+/* offset of the first byte of s that is in set, len if there is none */
+size_t
+scanbytes(const char *s, size_t len, const char *set) {
+#ifdef VECSCAN
+	size_t nset = strlen(set);
+
+	if(nset && nset <= SCANSET)
+		return hasavx2() ? scan_avx2(s, len, set, nset) : scan_sse2(s, len, set, nset);
+#endif
+	return scan_scalar(s, 0, len, set);
+}
+
+/* rejects overlong forms, surrogates and code points past U+10FFFF */
+int
+utf8valid(const char *str, size_t len) {
+	const unsigned char *s = (const unsigned char *)str;
+	unsigned long cp, min;
+	size_t i = 0, n, k;
+
+	for(;;) {
+		/* runs of ASCII are skipped a vector at a time */
+#ifdef VECSCAN
+		i = hasavx2() ? ascii_avx2(str, i, len) : ascii_sse2(str, i, len);
+#else
+		i = ascii_scalar(str, i, len);
+#endif
+		if(i >= len)
+			return 1;
+		if((s[i] & 0xe0) == 0xc0) {
+			n = 1;
+			cp = s[i] & 0x1f;
+			min = 0x80;
+		} else if((s[i] & 0xf0) == 0xe0) {
+			n = 2;
+			cp = s[i] & 0x0f;
+			min = 0x800;
+		} else if((s[i] & 0xf8) == 0xf0) {
+			n = 3;
+			cp = s[i] & 0x07;
+			min = 0x10000;
+		} else {
+			return 0;
+		}
+		if(len - i <= n)
+			return 0;
+		for(k = 1; k <= n; k++) {
+			if((s[i + k] & 0xc0) != 0x80)
+				return 0;
+			cp = (cp << 6) | (s[i + k] & 0x3f);
+		}
+		if(cp < min || cp > 0x10ffff || (cp >= 0xd800 && cp <= 0xdfff))
+			return 0;
+		i += n + 1;
+	}
+}
@@ -1,6 +1,10 @@
 /* See LICENSE file for copyright and license details. */
+#include <stddef.h>
 
 #define MAX(A, B)               ((A) > (B) ? (A) : (B))
 #define MIN(A, B)               ((A) < (B) ? (A) : (B))
+#define SCANSET                 8 /* bytes scanbytes() compares with vectors */
 
 void die(const char *errstr, ...);
+size_t scanbytes(const char *s, size_t len, const char *set);
+int utf8valid(const char *s, size_t len);